@@ -139,6 +139,31 @@ brelse(struct buf *b)
   
   release(&bcache.lock);
 }
+
+// Release a locked buffer holding file data, which the
+// page cache (pcache.c) keeps, so that the buffer cache
+// need not: move it to the tail of the MRU list, where
+// it is the first to be recycled.
+void
+bdrop(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bdrop");
+
+  releasesleep(&b->lock);
+
+  acquire(&bcache.lock);
+  b->refcnt--;
+  if (b->refcnt == 0) {
+    b->next->prev = b->prev;
+    b->prev->next = b->next;
+    b->prev = bcache.head.prev;
+    b->next = &bcache.head;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+  }
+  release(&bcache.lock);
+}
 //PAGEBREAK!
 // Blank page.
 
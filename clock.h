@@ -0,0 +1,9 @@
+// Interface for clock_gettime() and nanosleep().
+// Both the kernel and user programs use this header file.
+
+#define CLOCK_MONOTONIC 1  // time since boot
+
+struct timespec {
+  uint tv_sec;
+  uint tv_nsec;   // less than 1000000000
+};
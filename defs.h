@@ -1,16 +1,23 @@
 struct buf;
 struct context;
+struct fdtable;
 struct file;
+struct hrtimer;
 struct inode;
 struct pipe;
 struct proc;
+struct rcuhead;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct vmspace;
+struct waitq;
+struct pollwait;
 
 // bio.c
+void            bdrop(struct buf*);
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
@@ -27,12 +34,25 @@ int             exec(char*, char**);
 
 // file.c
 struct file*    filealloc(void);
+void            fdrelease(void);
+struct file*    fdget(int);
+struct fdtable* fdtablealloc(void);
+struct fdtable* fdtablecopy(struct fdtable*);
+struct fdtable* fdtabledup(struct fdtable*);
+void            fdtableput(struct fdtable*);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filesplice(struct file*, struct file*, int);
+int             filepoll(struct file*, struct pollwait*);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+void            pollfree(struct pollwait*);
+int             pollsleep(struct pollwait*);
+void            pollwait(struct waitq*, struct pollwait*);
+void            pollwake(void*);
+void            waitqwake(struct waitq*);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -42,17 +62,23 @@ struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+void            iunlockshared(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            readblocks(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+void            futexinit(void);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -63,11 +89,20 @@ void            ioapicenable(int irq, int cpu);
 extern uchar    ioapicid;
 void            ioapicinit(void);
 
+// ipi.c
+void            ipicall(uint, void (*)(void*), void*);
+void            ipiinit(void);
+void            ipiintr(void);
+
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
 void            kfree(char*);
+void            kincref(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+int             krefcount(char*);
+int             kzeroidle(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -78,7 +113,11 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
+void            lapicipiall(int);
 void            lapicstartap(uchar, uint);
+void            lapictimer(uint);
+uint            lapictimercount(void);
 void            microdelay(int);
 
 // log.c
@@ -87,10 +126,24 @@ void            log_write(struct buf*);
 void            begin_op();
 void            end_op();
 
+// mmap.c
+int             vmacopy(struct vmspace*, struct vmspace*);
+int             vmaattach(char**, int);
+int             vmadetach(uint);
+int             vmafault(struct vmspace*, uint, int);
+void            vmafree(struct vmspace*);
+
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pcache.c
+char*           pcacheget(struct inode*, uint);
+void            pcacheinit(void);
+void            pcacheinval(struct inode*);
+int             pcachereclaim(void);
+void            pcachewrite(struct inode*, char*, uint, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -98,15 +151,19 @@ void            picinit(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             pipepoll(struct pipe*, int, struct pollwait*);
+int             piperead(struct pipe*, char*, int, int);
+int             pipewrite(struct pipe*, char*, int, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(uint, uint, uint);
 int             cpuid(void);
 void            exit(void);
 int             fork(void);
 int             growproc(int);
+char*           evictpage(uint);
+int             join(int);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct proc*    myproc();
@@ -117,10 +174,27 @@ void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+int             vmpinned(struct vmspace*, uint, uint);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
 void            yield(void);
 
+// rcu.c
+void            call_rcu(struct rcuhead*, void (*)(void*), void*);
+void            rcuinit(void);
+void            rcuidle(int);
+void            rcuquiescent(void);
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+
+// swap.c
+char*           kalloc_evict(int);
+void            swapfree(uint);
+int             swapin(pde_t*, uint);
+void            swapinit(int);
+void            swapread(uint, char*);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -133,9 +207,14 @@ void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// shm.c
+void            shminit(void);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
+void            acquiresleepshared(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
+void            releasesleepshared(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
 
@@ -152,12 +231,25 @@ char*           strncpy(char*, const char*, int);
 int             argint(int, int*);
 int             argptr(int, char**, int);
 int             argstr(int, char**);
+int             argwptr(int, char**, int);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
+// sysproc.c
+void            lockbenchinit(void);
+
 // timer.c
+int             nanosleep(uint64);
+uint64          nsec(void);
+uint            nsecsplit(uint64, uint*);
+void            timeradd(struct hrtimer*);
+void            timercancel(struct hrtimer*);
+void            timeridle(void);
 void            timerinit(void);
+void            timerintr(void);
+void            timerstart(void);
+void            timerwake(void);
 
 // trap.c
 void            idtinit(void);
@@ -170,6 +262,12 @@ void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// vdso.c
+void            vdsoinit(void);
+int             vdsomap(pde_t*, int);
+void            vdsothreaded(pde_t*);
+void            vdsotick(uint, uint64, uint);
+
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
@@ -180,11 +278,24 @@ int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
+int             loadshared(pde_t*, char*, struct inode*, uint, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            tlbflush(struct vmspace*, uint, uint);
+int             copyin(void*, uint, uint);
+int             copyinstr(char*, uint, uint);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             mappages(pde_t*, void*, uint, uint, int);
+int             pagefault(uint, uint);
+int             uvmcheck(uint, uint, int);
+void            uvmunmap(struct vmspace*, uint, uint);
+uint*           walkpgdir(pde_t*, const void*, int);
+struct vmspace* vmspacealloc(void);
+struct vmspace* vmspacedup(struct vmspace*);
+void            vmspaceinit(void);
+void            vmspaceput(struct vmspace*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -6,6 +6,9 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
 
 int
 exec(char *path, char **argv)
@@ -16,7 +19,8 @@ exec(char *path, char **argv)
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
+  pde_t *pgdir;
+  struct vmspace *vm, *oldvm;
   struct proc *curproc = myproc();
 
   begin_op();
@@ -26,8 +30,8 @@ exec(char *path, char **argv)
     cprintf("exec: fail\n");
     return -1;
   }
-  ilock(ip);
-  pgdir = 0;
+  ilockshared(ip);  // other processes may exec it too
+  vm = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) != sizeof(elf))
@@ -35,7 +39,13 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
-  if((pgdir = setupkvm()) == 0)
+  // A new address space, so that a thread that execs
+  // leaves the one it shared to the other threads.
+  if((vm = vmspacealloc()) == 0)
+    goto bad;
+  if((pgdir = vm->pgdir = setupkvm()) == 0)
+    goto bad;
+  if(vdsomap(pgdir, curproc->pid) < 0)
     goto bad;
 
   // Load program into memory.
@@ -47,16 +57,29 @@ exec(char *path, char **argv)
       continue;
     if(ph.memsz < ph.filesz)
       goto bad;
-    if(ph.vaddr + ph.memsz < ph.vaddr)
-      goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr + ph.memsz < ph.vaddr || ph.vaddr + ph.memsz > MMAPBASE)
       goto bad;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
+    if((ph.flags & ELF_PROG_FLAG_WRITE) == 0 && ph.off % PGSIZE == 0 &&
+       ph.vaddr >= sz){
+      // Read-only segment: share the pages with other
+      // processes running this program.
+      if((sz = allocuvm(pgdir, sz, ph.vaddr)) == 0 && ph.vaddr != 0)
+        goto bad;
+      if(loadshared(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz,
+                    ph.memsz) < 0)
+        goto bad;
+      sz = ph.vaddr + ph.memsz;
+      continue;
+    }
+    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+      goto bad;
     if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
       goto bad;
   }
-  iunlockput(ip);
+  iunlockshared(ip);
+  iput(ip);
   end_op();
   ip = 0;
 
@@ -94,20 +117,21 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
-  oldpgdir = curproc->pgdir;
-  curproc->pgdir = pgdir;
-  curproc->sz = sz;
+  oldvm = curproc->vm;
+  vm->sz = sz;
+  curproc->vm = vm;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
-  freevm(oldpgdir);
+  vmspaceput(oldvm);
   return 0;
 
  bad:
-  if(pgdir)
-    freevm(pgdir);
+  if(vm)
+    vmspaceput(vm);
   if(ip){
-    iunlockput(ip);
+    iunlockshared(ip);
+    iput(ip);
     end_op();
   }
   return -1;
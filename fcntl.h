@@ -2,3 +2,11 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_NONBLOCK 0x800  // read() and write() return -EAGAIN, not sleep
+
+// fcntl() commands
+#define F_GETFL   1  // return the open mode and O_NONBLOCK
+#define F_SETFL   2  // set O_NONBLOCK from arg
+
+// A read() or write() on an O_NONBLOCK file would have slept.
+#define EAGAIN    11
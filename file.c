@@ -5,21 +5,40 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "proc.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "fcntl.h"
 
 struct devsw devsw[NDEV];
+static struct spinlock polllock;  // see pollwait
 struct {
   struct spinlock lock;
   struct file file[NFILE];
 } ftable;
 
+struct {
+  struct spinlock lock;
+  struct fdtable fdt[NPROC];
+} fdtables;
+
 void
 fileinit(void)
 {
+  int i;
+
   initlock(&ftable.lock, "ftable");
+  initlock(&polllock, "poll");
+  initlock(&fdtables.lock, "fdtables");
+  for(i = 0; i < NPROC; i++)
+    initlock(&fdtables.fdt[i].lock, "fdtable");
+  for(i = 0; i < NFILE; i++)
+    initsleeplock(&ftable.file[i].offlock, "fileoff");
 }
 
 // Allocate a file structure.
@@ -79,14 +98,140 @@ fileclose(struct file *f)
   }
 }
 
+// Allocate an empty descriptor table.
+// Returns 0 if there is no free slot.
+struct fdtable*
+fdtablealloc(void)
+{
+  struct fdtable *fdt;
+
+  acquire(&fdtables.lock);
+  for(fdt = fdtables.fdt; fdt < &fdtables.fdt[NPROC]; fdt++){
+    if(fdt->ref == 0){
+      fdt->ref = 1;
+      release(&fdtables.lock);
+      return fdt;
+    }
+  }
+  release(&fdtables.lock);
+  return 0;
+}
+
+// Allocate a copy of fdt, for fork().
+// Returns 0 if there is no free slot.
+struct fdtable*
+fdtablecopy(struct fdtable *fdt)
+{
+  struct fdtable *nfdt;
+  int fd;
+
+  if((nfdt = fdtablealloc()) == 0)
+    return 0;
+  acquire(&fdt->lock);
+  for(fd = 0; fd < NOFILE; fd++)
+    if(fdt->ofile[fd])
+      nfdt->ofile[fd] = filedup(fdt->ofile[fd]);
+  nfdt->cwd = idup(fdt->cwd);
+  release(&fdt->lock);
+  return nfdt;
+}
+
+// Increment ref count for fdt, for a new thread.
+struct fdtable*
+fdtabledup(struct fdtable *fdt)
+{
+  acquire(&fdtables.lock);
+  if(fdt->ref < 1)
+    panic("fdtabledup");
+  fdt->ref++;
+  release(&fdtables.lock);
+  return fdt;
+}
+
+// Drop a reference to fdt. The last one closes its files
+// and lets go of the current directory. May sleep.
+void
+fdtableput(struct fdtable *fdt)
+{
+  int fd;
+
+  acquire(&fdtables.lock);
+  if(fdt->ref < 1)
+    panic("fdtableput");
+  if(fdt->ref > 1){
+    fdt->ref--;
+    release(&fdtables.lock);
+    return;
+  }
+  release(&fdtables.lock);
+
+  // The only reference left is ours: nobody else can look.
+  for(fd = 0; fd < NOFILE; fd++){
+    if(fdt->ofile[fd]){
+      fileclose(fdt->ofile[fd]);
+      fdt->ofile[fd] = 0;
+    }
+  }
+  if(fdt->cwd){
+    begin_op();
+    iput(fdt->cwd);
+    end_op();
+    fdt->cwd = 0;
+  }
+
+  acquire(&fdtables.lock);
+  fdt->ref = 0;
+  release(&fdtables.lock);
+}
+
+// Return the current process's open file fd, or 0.
+// If other threads share the descriptor table, one of them
+// could close fd while the caller is using the file, so then
+// fdget() takes a reference of its own, which fdrelease()
+// drops when the system call is over.
+struct file*
+fdget(int fd)
+{
+  struct proc *p = myproc();
+  struct fdtable *fdt = p->fdt;
+  struct file *f;
+  int i;
+
+  if(fd < 0 || fd >= NOFILE)
+    return 0;
+  if(fdt->ref == 1)  // only this thread, which is busy here
+    return fdt->ofile[fd];
+  acquire(&fdt->lock);
+  if((f = fdt->ofile[fd]) != 0){
+    for(i = 0; i < p->nhold && p->fhold[i] != f; i++)
+      ;
+    if(i == NELEM(p->fhold))
+      f = 0;
+    else if(i == p->nhold)
+      p->fhold[p->nhold++] = filedup(f);
+  }
+  release(&fdt->lock);
+  return f;
+}
+
+// Drop the references fdget() took for the current system call.
+void
+fdrelease(void)
+{
+  struct proc *p = myproc();
+
+  while(p->nhold > 0)
+    fileclose(p->fhold[--p->nhold]);
+}
+
 // Get metadata about file f.
 int
 filestat(struct file *f, struct stat *st)
 {
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    ilockshared(f->ip);
     stati(f->ip, st);
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     return 0;
   }
   return -1;
@@ -101,12 +246,28 @@ fileread(struct file *f, char *addr, int n)
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+    return piperead(f->pipe, addr, n, f->nonblock);
   if(f->type == FD_INODE){
-    ilock(f->ip);
+    // Devices have no non-blocking read: ask first.
+    if(f->nonblock && f->ip->type == T_DEV && (filepoll(f, 0) & POLLIN) == 0)
+      return -EAGAIN;
+    // Readers can share the inode, but f->off must not be
+    // when f itself is shared, after fork() or dup(): offlock
+    // serializes it with other reads and with filesplice().
+    // Devices need the exclusive inode lock (see readi).
+    if(f->ref > 1 || f->ip->type == T_DEV){
+      acquiresleep(&f->offlock);
+      ilock(f->ip);
+      if((r = readi(f->ip, addr, f->off, n)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+      releasesleep(&f->offlock);
+      return r;
+    }
+    ilockshared(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
-    iunlock(f->ip);
+    iunlockshared(f->ip);
     return r;
   }
   panic("fileread");
@@ -122,7 +283,7 @@ filewrite(struct file *f, char *addr, int n)
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+    return pipewrite(f->pipe, addr, n, f->nonblock);
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -155,3 +316,207 @@ filewrite(struct file *f, char *addr, int n)
   panic("filewrite");
 }
 
+
+// Move up to n bytes from in to out without passing them
+// through user memory. A file's data is written to out
+// straight from the page cache; a pipe's is read into a
+// kernel page first.
+// Returns the number of bytes moved, or -1 if none could be.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  struct inode *ip;
+  char *page;
+  int tot, m, want, o, r;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_INODE && in->ip->type != T_FILE)
+    return -1;
+
+  // in->off stays reserved from reading it to advancing it
+  // past what was written, as in fileread().
+  if(in->type == FD_INODE)
+    acquiresleep(&in->offlock);
+  for(tot = 0; tot < n; tot += m){
+    want = n - tot < PGSIZE ? n - tot : PGSIZE;
+    if(in->type == FD_PIPE){
+      if((page = kalloc()) == 0)
+        break;
+      o = 0;
+      m = piperead(in->pipe, page, want, in->nonblock);
+    } else {
+      ip = in->ip;
+      ilock(ip);
+      page = 0;
+      o = m = 0;
+      if(in->off < ip->size &&
+         (page = pcacheget(ip, PGROUNDDOWN(in->off))) != 0){
+        o = in->off % PGSIZE;
+        m = PGSIZE - o;
+        if(m > ip->size - in->off)
+          m = ip->size - in->off;
+        if(m > want)
+          m = want;
+      }
+      iunlock(ip);
+    }
+    if(m <= 0){
+      if(page)
+        kfree(page);
+      if(m < 0 && tot == 0)
+        tot = m;
+      break;
+    }
+    // What has been taken from in must not be lost, so
+    // out is written in full even if it is non-blocking.
+    if(out->type == FD_PIPE)
+      r = pipewrite(out->pipe, page + o, m, 0);
+    else
+      r = filewrite(out, page + o, m);
+    kfree(page);
+    // Only what reached out is taken from a file; a pipe's
+    // bytes are gone either way. The inode lock orders this
+    // with filewrite(), which does not take offlock.
+    if(in->type == FD_INODE && r > 0){
+      ilock(in->ip);
+      in->off += r;
+      iunlock(in->ip);
+    }
+    if(r != m){
+      if(r > 0)
+        tot += r;
+      if(tot == 0)
+        tot = -1;
+      break;
+    }
+    // A pipe returns what it has: do not wait for more.
+    if(in->type == FD_PIPE && m < want){
+      tot += m;
+      break;
+    }
+  }
+  if(in->type == FD_INODE)
+    releasesleep(&in->offlock);
+  return tot;
+}
+
+//PAGEBREAK!
+// Wait queues, for poll().
+//
+// poll() cannot sleep on the channels of several objects at
+// once, so each object it may wait for (a pipe, the console)
+// keeps a struct waitq. poll() hangs an entry on the queue of
+// every object it looks at, then sleeps on its struct pollwait
+// until one of the queues is woken. The queues are protected
+// by polllock, which comes after the objects' own locks.
+
+// Add the poll() call pw, if any, to q. Called by an object's
+// poll function before it looks at the object's state.
+void
+pollwait(struct waitq *q, struct pollwait *pw)
+{
+  struct waitent *e;
+
+  if(pw == 0 || pw->n == NELEM(pw->ent))
+    return;
+  e = &pw->ent[pw->n++];
+  e->q = q;
+  e->pw = pw;
+  acquire(&polllock);
+  e->next = q->head;
+  q->head = e;
+  release(&polllock);
+}
+
+// Take pw off all the queues it is on.
+void
+pollfree(struct pollwait *pw)
+{
+  struct waitent *e, **pp;
+
+  acquire(&polllock);
+  for(e = pw->ent; e < &pw->ent[pw->n]; e++){
+    for(pp = &e->q->head; *pp != e; pp = &(*pp)->next)
+      ;
+    *pp = e->next;
+  }
+  release(&polllock);
+  pw->n = 0;
+}
+
+// Wake the poll() calls waiting on q. Must hold the lock that
+// protects the state poll looks at, so that a poll() either
+// sees the change or is already on q.
+void
+waitqwake(struct waitq *q)
+{
+  struct waitent *e;
+
+  if(q->head == 0)
+    return;
+  acquire(&polllock);
+  for(e = q->head; e; e = e->next){
+    e->pw->woken = 1;
+    wakeup(e->pw);
+  }
+  release(&polllock);
+}
+
+// Wake the poll() call pw whatever its queues say.
+// A timer callback, for poll() timeouts.
+void
+pollwake(void *pw)
+{
+  acquire(&polllock);
+  ((struct pollwait*)pw)->woken = 1;
+  wakeup(pw);
+  release(&polllock);
+}
+
+// Sleep until one of the queues pw is on is woken, unless
+// that happened already. Returns -1 if the process is killed.
+int
+pollsleep(struct pollwait *pw)
+{
+  acquire(&polllock);
+  while(!pw->woken){
+    if(myproc()->killed){
+      release(&polllock);
+      return -1;
+    }
+    sleep(pw, &polllock);
+  }
+  pw->woken = 0;
+  release(&polllock);
+  return 0;
+}
+
+// Which of POLLIN and POLLOUT f is ready for, plus POLLERR and
+// POLLHUP for pipes. Puts pw on the queue of the object f
+// refers to, if it may have to wait for it.
+int
+filepoll(struct file *f, struct pollwait *pw)
+{
+  int r;
+  short type, major;
+
+  if(f->type == FD_PIPE)
+    r = pipepoll(f->pipe, f->writable, pw);
+  else if(f->type == FD_INODE){
+    ilockshared(f->ip);
+    type = f->ip->type;
+    major = f->ip->major;
+    iunlockshared(f->ip);
+    if(type == T_DEV && major >= 0 && major < NDEV && devsw[major].poll)
+      r = devsw[major].poll(f->ip, pw);
+    else
+      r = POLLIN | POLLOUT;
+  } else
+    r = 0;
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r;
+}
@@ -3,9 +3,41 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;  // O_NONBLOCK
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  struct sleeplock offlock;  // held from reading off to advancing it
+};
+
+// The open files and current directory of a process, shared
+// by all its threads (see clone in proc.c) as struct vmspace is.
+// lock protects ofile[] and cwd.
+struct fdtable {
+  int ref;                     // Threads using it; 0 if the slot is free
+  struct spinlock lock;
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+};
+
+// Processes in poll() waiting for something to happen to an
+// object that files refer to (see pollwait in file.c).
+struct waitq {
+  struct waitent *head;
+};
+
+struct waitent {
+  struct waitq *q;
+  struct pollwait *pw;
+  struct waitent *next;
+};
+
+// One poll() call: an entry on the queue of each object
+// it waits for.
+struct pollwait {
+  int woken;                   // a queue was woken since the last scan
+  int n;                       // entries in use
+  struct waitent ent[NOFILE+1];
 };
 
 
@@ -30,6 +62,7 @@ struct inode {
 struct devsw {
   int (*read)(struct inode*, char*, int);
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*, struct pollwait*);  // 0: never blocks
 };
 
 extern struct devsw devsw[];
@@ -14,6 +14,7 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
@@ -155,9 +156,11 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// entries: ip->dev and ip->inum, which indicate which i-node an
+// entry holds, change only under icache.lock, and only while
+// ip->ref is zero, which marks the entry free. ip->ref itself is
+// updated with atomic instructions, so that iget() can find a
+// cached inode without taking icache.lock (see iget).
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
@@ -235,6 +238,34 @@ iupdate(struct inode *ip)
   brelse(bp);
 }
 
+// Take a reference to ip unless its entry is free.
+// Returns 1 on success, 0 if ip->ref was zero.
+static int
+itryref(struct inode *ip)
+{
+  int r;
+
+  while((r = ip->ref) > 0)
+    if(cmpxchg((uint*)&ip->ref, r, r+1) == r)
+      return 1;
+  return 0;
+}
+
+// Drop a reference that iget() took on an entry that had
+// been recycled for another inode in the meantime.
+static void
+iputstray(struct inode *ip)
+{
+  int r;
+
+  while((r = ip->ref) > 1)
+    if(cmpxchg((uint*)&ip->ref, r, r-1) == r)
+      return;
+  // Ours is the only reference, so nobody holds ip->lock:
+  // let iput() free the inode if that was left to us.
+  iput(ip);
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
@@ -243,13 +274,25 @@ iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
+  // Is the inode already cached? Look without taking
+  // icache.lock first. An entry can be recycled whenever its
+  // ref is zero, even between checking dev and inum and taking
+  // the reference, so check them again once it is held.
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    if(ip->dev == dev && ip->inum == inum && itryref(ip)){
+      if(ip->dev == dev && ip->inum == inum)
+        return ip;
+      iputstray(ip);
+      break;
+    }
+  }
+
   acquire(&icache.lock);
 
-  // Is the inode already cached?
+  // Look again, now that no entry can be recycled under us.
   empty = 0;
   for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+    if(ip->dev == dev && ip->inum == inum && itryref(ip)){
       release(&icache.lock);
       return ip;
     }
@@ -264,8 +307,10 @@ iget(uint dev, uint inum)
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
-  ip->ref = 1;
   ip->valid = 0;
+  // Publish the entry only once it is filled in.
+  __sync_synchronize();
+  ip->ref = 1;
   release(&icache.lock);
 
   return ip;
@@ -276,9 +321,7 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  xadd((uint*)&ip->ref, 1);
   return ip;
 }
 
@@ -321,6 +364,36 @@ iunlock(struct inode *ip)
   releasesleep(&ip->lock);
 }
 
+// Lock the given inode in shared mode, for reading only:
+// other readers may hold it at the same time.
+// Reads the inode from disk if necessary.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquiresleepshared(&ip->lock);
+  if(ip->valid == 0){
+    // Only an exclusive holder may fill in the inode.
+    // Our reference keeps it valid once it has been read.
+    releasesleepshared(&ip->lock);
+    ilock(ip);
+    iunlock(ip);
+    acquiresleepshared(&ip->lock);
+  }
+}
+
+// Unlock an inode locked with ilockshared().
+void
+iunlockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("iunlockshared");
+
+  releasesleepshared(&ip->lock);
+}
+
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
 // be recycled.
@@ -333,10 +406,7 @@ iput(struct inode *ip)
 {
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
-    int r = ip->ref;
-    release(&icache.lock);
-    if(r == 1){
+    if(ip->ref == 1){
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
       ip->type = 0;
@@ -346,9 +416,7 @@ iput(struct inode *ip)
   }
   releasesleep(&ip->lock);
 
-  acquire(&icache.lock);
-  ip->ref--;
-  release(&icache.lock);
+  xadd((uint*)&ip->ref, -1);
 }
 
 // Common idiom: unlock, then put.
@@ -432,10 +500,11 @@ itrunc(struct inode *ip)
 
   ip->size = 0;
   iupdate(ip);
+  pcacheinval(ip);  // cached pages would now be past the end
 }
 
 // Copy stat information from inode.
-// Caller must hold ip->lock.
+// Caller must hold ip->lock, shared or exclusive.
 void
 stati(struct inode *ip, struct stat *st)
 {
@@ -447,17 +516,40 @@ stati(struct inode *ip, struct stat *st)
 }
 
 //PAGEBREAK!
-// Read data from inode.
+// Read data from inode block by block, bypassing the page
+// cache. Used to fill the page cache, and by readi() if
+// memory is too short for it. [off, off+n) must lie within
+// the file.
 // Caller must hold ip->lock.
+void
+readblocks(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m;
+  struct buf *bp;
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    memmove(dst, bp->data + off%BSIZE, m);
+    bdrop(bp);
+  }
+}
+
+// Read data from inode, through the page cache.
+// Caller must hold ip->lock, shared or exclusive.
 int
 readi(struct inode *ip, char *dst, uint off, uint n)
 {
   uint tot, m;
-  struct buf *bp;
+  char *mem;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
       return -1;
+    // Device read functions may drop and retake ip->lock,
+    // which only works if it is held exclusively.
+    if(!holdingsleep(&ip->lock))
+      return -1;
     return devsw[ip->major].read(ip, dst, n);
   }
 
@@ -467,10 +559,12 @@ readi(struct inode *ip, char *dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
-    brelse(bp);
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((mem = pcacheget(ip, PGROUNDDOWN(off))) != 0){
+      memmove(dst, mem + off%PGSIZE, m);
+      kfree(mem);
+    } else
+      readblocks(ip, dst, off, m);
   }
   return n;
 }
@@ -495,13 +589,16 @@ writei(struct inode *ip, char *src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  // The blocks go to disk through the log as before;
+  // the page cache is brought up to date afterwards.
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
     memmove(bp->data + off%BSIZE, src, m);
     log_write(bp);
-    brelse(bp);
+    bdrop(bp);
   }
+  pcachewrite(ip, src - n, off - n, n);
 
   if(n > 0 && off > ip->size){
     ip->size = off;
@@ -521,6 +618,7 @@ namecmp(const char *s, const char *t)
 
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
+// Caller must hold dp->lock, shared or exclusive.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
@@ -628,25 +726,33 @@ namex(char *path, int nameiparent, char *name)
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(myproc()->cwd);
+  else {
+    acquire(&myproc()->fdt->lock);
+    ip = idup(myproc()->fdt->cwd);
+    release(&myproc()->fdt->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
-    ilock(ip);
+    // Lookups only read directories, so processes
+    // walking the same path need not wait for each other.
+    ilockshared(ip);
     if(ip->type != T_DIR){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
     if(nameiparent && *path == '\0'){
       // Stop one level early.
-      iunlock(ip);
+      iunlockshared(ip);
       return ip;
     }
     if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
+      iunlockshared(ip);
+      iput(ip);
       return 0;
     }
-    iunlockput(ip);
+    iunlockshared(ip);
+    iput(ip);
     ip = next;
   }
   if(nameiparent){
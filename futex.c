@@ -0,0 +1,78 @@
+//
+// Futexes: sleep and wakeup on a word of user memory, for
+// user-space locks (see mutex_lock in ulib.c) that only enter
+// the kernel when they have to wait.
+//
+// A futex is named by the physical address of the word, so
+// that processes mapping the same page at different addresses,
+// through a MAP_SHARED mapping, find the same futex. The
+// kernel address of the word serves as the sleep channel.
+// Shared mappings are never swapped out (evictpage only takes
+// private pages below the sbrk() size, and none with a second
+// reference), and a waiter's own page stays pinned while it
+// sleeps, so the address cannot change under a waiter.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
+#include "futex.h"
+
+// Makes checking the word and going to sleep atomic
+// with respect to changing it and waking up.
+struct spinlock futexlock;
+
+void
+futexinit(void)
+{
+  initlock(&futexlock, "futex");
+}
+
+// int futex(void *addr, int op, int val)
+// FUTEX_WAIT: if *addr is still val, sleep until woken.
+// Returns 0 when woken, -1 at once if *addr had changed.
+// Wakeups can be spurious: callers check the word again.
+// FUTEX_WAKE: wake at most val waiters.
+// Returns the number woken.
+int
+sys_futex(void)
+{
+  struct proc *curproc = myproc();
+  int addr, op, val;
+  int *key;
+
+  if(argint(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  if(addr % 4 != 0 || uvmcheck(addr, 4, 1) < 0)
+    return -1;
+  key = (int*)(uva2ka(curproc->vm->pgdir, (char*)PGROUNDDOWN(addr)) +
+               addr % PGSIZE);
+
+  switch(op){
+  case FUTEX_WAIT:
+    acquire(&futexlock);
+    if(*key != val){
+      release(&futexlock);
+      return -1;
+    }
+    if(curproc->killed){
+      release(&futexlock);
+      return -1;
+    }
+    sleep(key, &futexlock);
+    release(&futexlock);
+    return 0;
+  case FUTEX_WAKE:
+    acquire(&futexlock);
+    val = wakeupn(key, val);
+    release(&futexlock);
+    return val;
+  }
+  return -1;
+}
@@ -0,0 +1,5 @@
+// Operations for futex().
+// Both the kernel and user programs use this header file.
+
+#define FUTEX_WAIT  0  // sleep if *addr == val
+#define FUTEX_WAKE  1  // wake up to val processes waiting on addr
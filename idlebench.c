@@ -0,0 +1,51 @@
+// Idle CPU benchmark: one process forks and reaps children, a
+// workload that lives on ptable.lock, while the other CPUs have
+// nothing to run. Prints the cycles taken and the contention
+// seen on ptable.lock, which idle CPUs should not add to.
+// Run with, say, make qemu CPUS=8 for 1 busy and 7 idle CPUs.
+//
+// usage: idlebench [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "param.h"
+#include "lockstat.h"
+
+struct lockstat st[NLOCKCLASS];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat *s;
+  int n, i, pid;
+  uint t0, t1;
+
+  n = argc > 1 ? atoi(argv[1]) : 1000;
+
+  lockstat(0, 0);
+  t0 = (uint)rdtsc();
+  for(i = 0; i < n; i++){
+    if((pid = fork()) < 0){
+      printf(2, "idlebench: fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+  t1 = (uint)rdtsc();
+
+  if((i = lockstat(st, NLOCKCLASS)) < 0){
+    printf(2, "idlebench: lockstat failed\n");
+    exit();
+  }
+  printf(1, "%d forks in %d cycles, %d cycles each\n",
+         n, t1 - t0, (t1 - t0) / n);
+  for(s = st; s < &st[i] && s < &st[NLOCKCLASS]; s++)
+    if(strcmp(s->name, "ptable") == 0)
+      printf(1, "ptable: %d acquires, %d contended, %d spin-kcycles\n",
+             s->nacquire, s->ncontend, (uint)(s->spin >> 10));
+  exit();
+}
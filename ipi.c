@@ -0,0 +1,111 @@
+// Inter-processor calls.
+//
+// ipicall() runs a function on other CPUs: it puts a request
+// on the call queue of each target CPU and sends it an IRQ_CALL
+// IPI, whose handler, ipiintr(), runs the CPU's queued requests.
+// The caller waits until every target has run the function.
+// While it waits it runs the requests queued for its own CPU,
+// so two CPUs calling each other at once do not deadlock.
+//
+// A target takes the IPI only once it has interrupts on, so the
+// caller must not hold a spinlock another CPU might be spinning
+// on: that CPU would never take the IPI.
+//
+// The functions run in interrupt context and must not sleep.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "spinlock.h"
+
+struct callreq {
+  void (*fn)(void*);
+  void *arg;
+  volatile int done;
+  struct callreq *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct callreq *head;
+} callq[NCPU];
+
+void
+ipiinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&callq[i].lock, "ipi");
+}
+
+// Run the requests queued for this CPU.
+// Called with interrupts off.
+void
+ipiintr(void)
+{
+  struct callreq *r, *next;
+  int id;
+
+  id = cpuid();
+  if(callq[id].head == 0)
+    return;
+  acquire(&callq[id].lock);
+  r = callq[id].head;
+  callq[id].head = 0;
+  release(&callq[id].lock);
+  for(; r; r = next){
+    next = r->next;  // r is the caller's, and gone once done
+    r->fn(r->arg);
+    __sync_synchronize();
+    r->done = 1;
+  }
+}
+
+// Call fn(arg) on every started CPU in mask (bit i for cpus[i])
+// other than this one, and wait for all of them to return.
+void
+ipicall(uint mask, void (*fn)(void*), void *arg)
+{
+  struct callreq req[NCPU];
+  uint sent;
+  int i, me;
+
+  pushcli();
+  me = cpuid();
+  sent = 0;
+  for(i = 0; i < ncpu; i++){
+    req[i].done = 1;
+    if(i == me || (mask & (1 << i)) == 0 || !cpus[i].started)
+      continue;
+    req[i].fn = fn;
+    req[i].arg = arg;
+    req[i].done = 0;
+    acquire(&callq[i].lock);
+    req[i].next = callq[i].head;
+    callq[i].head = &req[i];
+    release(&callq[i].lock);
+    sent |= 1 << i;
+  }
+
+  // One broadcast IPI if every other CPU is a target.
+  if(sent == (((1 << ncpu) - 1) & ~(1 << me)))
+    lapicipiall(T_IRQ0 + IRQ_CALL);
+  else
+    for(i = 0; i < ncpu; i++)
+      if(sent & (1 << i))
+        lapicipi(cpus[i].apicid, T_IRQ0 + IRQ_CALL);
+
+  for(i = 0; i < ncpu; i++){
+    while(!req[i].done){
+      ipiintr();
+      pause();
+    }
+  }
+  popcli();
+}
@@ -21,6 +21,9 @@ struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct run *zerolist;  // pages already filled with zeros
+  int nzero;             // number of pages on zerolist
+  ushort ref[PHYSTOP/PGSIZE];  // references to each allocated page
 } kmem;
 
 // Initialization happens in two phases.
@@ -52,10 +55,11 @@ freerange(void *vstart, void *vend)
     kfree(p);
 }
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when the last reference is dropped.
 void
 kfree(char *v)
 {
@@ -64,6 +68,18 @@ kfree(char *v)
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] > 1){
+    kmem.ref[V2P(v)/PGSIZE]--;
+    if(kmem.use_lock)
+      release(&kmem.lock);
+    return;
+  }
+  kmem.ref[V2P(v)/PGSIZE] = 0;
+  if(kmem.use_lock)
+    release(&kmem.lock);
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
@@ -76,9 +92,42 @@ kfree(char *v)
     release(&kmem.lock);
 }
 
+// Add a reference to an allocated page, so that it
+// can be mapped in more than one page table.
+// Each reference is dropped with kfree().
+void
+kincref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kincref");
+
+  acquire(&kmem.lock);
+  if(kmem.ref[V2P(v)/PGSIZE] < 1)
+    panic("kincref: free page");
+  kmem.ref[V2P(v)/PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Return the number of references to an allocated page.
+int
+krefcount(char *v)
+{
+  int n;
+
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("krefcount");
+
+  acquire(&kmem.lock);
+  n = kmem.ref[V2P(v)/PGSIZE];
+  release(&kmem.lock);
+  return n;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
+// Prefers dirty pages so that the zeroed pool is
+// saved for kalloc_zeroed().
 char*
 kalloc(void)
 {
@@ -89,8 +138,71 @@ kalloc(void)
   r = kmem.freelist;
   if(r)
     kmem.freelist = r->next;
+  else if((r = kmem.zerolist) != 0){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+  }
+  if(r)
+    kmem.ref[V2P(r)/PGSIZE] = 1;
   if(kmem.use_lock)
     release(&kmem.lock);
   return (char*)r;
 }
 
+// Allocate one page of physical memory filled with zeros.
+// Takes a page from the pool maintained by idle CPUs
+// (see kzeroidle) if one is available, and only clears
+// the page inline if the pool is empty.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  r = kmem.zerolist;
+  if(r){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    kmem.ref[V2P(r)/PGSIZE] = 1;
+  }
+  if(kmem.use_lock)
+    release(&kmem.lock);
+  if(r){
+    r->next = 0;  // the link was the only non-zero word
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
+  return (char*)r;
+}
+
+// Move one free page to the zeroed pool.
+// Called by a CPU that has nothing to run (see scheduler).
+// The page is cleared without holding kmem.lock, so other
+// CPUs can keep allocating meanwhile.
+// Returns 1 if a page was zeroed, 0 if the pool is full
+// or there are no free pages.
+int
+kzeroidle(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  if(kmem.nzero >= NZEROPG || (r = kmem.freelist) == 0){
+    release(&kmem.lock);
+    return 0;
+  }
+  kmem.freelist = r->next;
+  release(&kmem.lock);
+
+  memset(r, 0, PGSIZE);
+
+  acquire(&kmem.lock);
+  r->next = kmem.zerolist;
+  kmem.zerolist = r;
+  kmem.nzero++;
+  release(&kmem.lock);
+  return 1;
+}
+
@@ -26,6 +26,7 @@
   #define DEASSERT   0x00000000
   #define LEVEL      0x00008000   // Level triggered
   #define BCAST      0x00080000   // Send to all APICs, including self.
+  #define OTHERS     0x000C0000   // Send to all APICs, excluding self.
   #define BUSY       0x00001000
   #define FIXED      0x00000000
 #define ICRHI   (0x0310/4)   // Interrupt Command [63:32]
@@ -61,9 +62,9 @@ lapicinit(void)
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
   // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // from lapic[TICR] and then issues an interrupt, until
+  // timerstart() switches it to one-shot mode, with counts
+  // calibrated by timerinit() (see timer.c).
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
   lapicw(TICR, 10000000);
@@ -105,6 +106,26 @@ lapicid(void)
   return lapic[ID] >> 24;
 }
 
+// Arm the timer to interrupt once, after count bus cycles,
+// or stop it if count is 0.
+void
+lapictimer(uint count)
+{
+  if(!lapic)
+    return;
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, count);
+}
+
+// The timer's current count, for calibration.
+uint
+lapictimercount(void)
+{
+  if(!lapic)
+    return 0;
+  return lapic[TCCR];
+}
+
 // Acknowledge interrupt.
 void
 lapiceoi(void)
@@ -113,6 +134,26 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send interrupt vector to the CPU with the given APIC ID.
+void
+lapicipi(uchar apicid, int vector)
+{
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Send interrupt vector to every CPU but this one.
+void
+lapicipiall(int vector)
+{
+  lapicw(ICRHI, 0);
+  lapicw(ICRLO, OTHERS | FIXED | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
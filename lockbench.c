@@ -0,0 +1,56 @@
+// Lock stress benchmark: processes on all CPUs hammer one
+// kernel spinlock, then the distribution of acquire()
+// latencies seen by each CPU is printed.
+//
+// usage: lockbench [nproc [n]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+
+uint hist[NCPU][NLATBUCKET];
+
+int
+main(int argc, char *argv[])
+{
+  int nproc, n, i, c, b, pid;
+  uint tot, sum;
+
+  nproc = argc > 1 ? atoi(argv[1]) : NCPU;
+  n = argc > 2 ? atoi(argv[2]) : 10000;
+
+  lockbench(0, (uint*)hist);  // clear old results
+  for(i = 0; i < nproc; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(2, "lockbench: fork failed\n");
+      break;
+    }
+    if(pid == 0){
+      lockbench(n, 0);
+      exit();
+    }
+  }
+  while(wait() >= 0)
+    ;
+  lockbench(0, (uint*)hist);
+
+  for(c = 0; c < NCPU; c++){
+    tot = 0;
+    for(b = 0; b < NLATBUCKET; b++)
+      tot += hist[c][b];
+    if(tot == 0)
+      continue;
+    printf(1, "cpu %d: %d acquires\n", c, tot);
+    sum = 0;
+    for(b = 0; b < NLATBUCKET; b++){
+      if(hist[c][b] == 0)
+        continue;
+      sum += hist[c][b];
+      printf(1, "  < 2^%d cycles: %d (%d%% cumulative)\n",
+             b+1, hist[c][b], (int)(sum*100/tot));
+    }
+  }
+  exit();
+}
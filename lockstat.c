@@ -0,0 +1,60 @@
+// Print the locks with the most contention, either since
+// boot or while running a command.
+//
+// usage: lockstat [command [arg ...]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "lockstat.h"
+
+#define NTOP 20  // how many locks to print
+
+struct lockstat st[NLOCKCLASS];
+int order[NLOCKCLASS];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat *s;
+  int n, i, j, k, pid;
+
+  if(argc > 1){
+    lockstat(0, 0);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "lockstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+
+  if((n = lockstat(st, NLOCKCLASS)) < 0){
+    printf(2, "lockstat: lockstat failed\n");
+    exit();
+  }
+  if(n > NLOCKCLASS)
+    n = NLOCKCLASS;
+
+  // Sort by time spent waiting, most first.
+  for(i = 0; i < n; i++){
+    k = i;
+    for(j = i; j > 0 && st[order[j-1]].spin < st[k].spin; j--)
+      order[j] = order[j-1];
+    order[j] = k;
+  }
+
+  printf(1, "name acquires contended spin-kcycles maxhold-kcycles\n");
+  for(i = 0; i < n && i < NTOP; i++){
+    s = &st[order[i]];
+    printf(1, "%s %d %d %d %d\n", s->name, s->nacquire, s->ncontend,
+           (uint)(s->spin >> 10), (uint)(s->maxhold >> 10));
+  }
+  exit();
+}
@@ -0,0 +1,10 @@
+// Lock contention statistics, as returned by lockstat().
+// Locks that share a name (all the pipe locks, say) are
+// counted together.
+struct lockstat {
+  char name[16];
+  uint nacquire;     // Number of acquisitions
+  uint ncontend;     // Acquisitions that had to wait
+  uint64 spin;       // Cycles spent waiting
+  uint64 maxhold;    // Longest time held, in cycles
+};
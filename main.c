@@ -26,13 +26,22 @@ main(void)
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
   uartinit();      // serial port
+  timerinit();     // calibrate the TSC and the APIC timer
   pinit();         // process table
+  vmspaceinit();   // address space table
+  rcuinit();       // deferred freeing
+  ipiinit();       // inter-processor calls
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcacheinit();    // file page cache
   fileinit();      // file table
+  futexinit();     // user-space sleep and wakeup
+  shminit();       // shared memory segments
+  lockbenchinit(); // lock stress benchmark
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  vdsoinit();      // user-readable kernel data
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
@@ -53,6 +62,7 @@ mpmain(void)
 {
   cprintf("cpu%d: starting %d\n", cpuid(), cpuid());
   idtinit();       // load idt register
+  timerstart();    // one-shot APIC timer
   xchg(&(mycpu()->started), 1); // tell startothers() we're up
   scheduler();     // start running processes
 }
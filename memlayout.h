@@ -8,6 +8,12 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// User address space above the sbrk() heap used by mmap().
+#define MMAPBASE 0x40000000         // Lowest address for mappings
+#define MMAPTOP  0x7FFFE000         // First address above mappings
+
+// The vdso pages (vdso.h) lie between MMAPTOP and KERNBASE.
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
 
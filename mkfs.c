@@ -18,7 +18,8 @@
 #define NINODES 200
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | inode blocks | free bit map | data blocks |
+//                                                                  swap ]
 
 int nbitmap = FSSIZE/(BSIZE*8) + 1;
 int ninodeblocks = NINODES / IPB + 1;
@@ -72,12 +73,22 @@ main(int argc, char *argv[])
   struct dirent de;
   char buf[BSIZE];
   struct dinode din;
+  int nswap;
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  // -n leaves out the swap area, for an image small enough
+  // to link into kernelmemfs.
+  nswap = NSWAP;
+  if(argc > 1 && strcmp(argv[1], "-n") == 0){
+    nswap = 0;
+    argc--;
+    argv++;
+  }
+
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-n] fs.img files...\n");
     exit(1);
   }
 
@@ -101,13 +112,15 @@ main(int argc, char *argv[])
   sb.logstart = xint(2);
   sb.inodestart = xint(2+nlog);
   sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.swapstart = xint(FSSIZE);
+  sb.nswap = xint(nswap);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d swap blocks %d\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE, nswap ? SWAPSIZE : 0);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < FSSIZE + (nswap ? SWAPSIZE : 0); i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
@@ -0,0 +1,12 @@
+// Protection and flag bits for mmap().
+// Both the kernel and user programs use this header file.
+
+#define PROT_NONE     0x0
+#define PROT_READ     0x1
+#define PROT_WRITE    0x2
+
+#define MAP_SHARED    0x01  // share the pages with forked children
+#define MAP_PRIVATE   0x02  // changes are private to the process
+#define MAP_ANONYMOUS 0x20  // zero-filled memory, not backed by a file
+
+#define MAP_FAILED    ((void*)-1)
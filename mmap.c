@@ -0,0 +1,377 @@
+//
+// Memory-mapped regions: mmap() and munmap().
+//
+// Each process describes its mappings with the vma[] array of
+// its address space (struct vmspace, shared by its threads).
+// Mappings live between MMAPBASE and MMAPTOP, above the sbrk()
+// heap, so they never collide with growproc().
+//
+// Private mappings are filled lazily: the first touch of a page
+// faults, and vmafault() allocates a zeroed page or reads the
+// page from the mapped file. Read-only file pages come from the
+// page cache (pcache.c) and are shared. Shared anonymous
+// mappings are allocated at mmap() time instead, so that a
+// forked child maps the very same pages as its parent. Shared
+// file mappings must be read-only, which makes a filled page
+// indistinguishable from the file itself.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "mman.h"
+#include "vmspace.h"
+
+// Return the region of vm containing va, or 0.
+static struct vma*
+findvma(struct vmspace *vm, uint va)
+{
+  struct vma *v;
+
+  for(v = vm->vma; v < &vm->vma[NVMA]; v++)
+    if(v->len && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// Find len bytes of unmapped address space for a new region.
+// Returns the start address, or 0 if there is no room.
+static uint
+mmapaddr(struct vmspace *vm, uint len)
+{
+  struct vma *v;
+  uint a;
+
+  a = MMAPBASE;
+again:
+  if(a + len > MMAPTOP || a + len < a)
+    return 0;
+  for(v = vm->vma; v < &vm->vma[NVMA]; v++){
+    if(v->len && a < v->addr + v->len && v->addr < a + len){
+      a = v->addr + v->len;
+      goto again;
+    }
+  }
+  return a;
+}
+
+// Fill in the page at va, which lies in one of vm's regions.
+// write is set if the fault was caused by a write.
+// Caller must hold vm->lock.
+// Returns 0 on success, -1 if va is not mapped for that access
+// or memory runs out.
+int
+vmafault(struct vmspace *vm, uint va, int write)
+{
+  struct vma *v;
+  char *mem;
+  uint a, off;
+  int n, perm;
+
+  if((v = findvma(vm, va)) == 0)
+    return -1;
+  if((v->prot & PROT_READ) == 0 || (write && (v->prot & PROT_WRITE) == 0))
+    return -1;
+
+  a = PGROUNDDOWN(va);
+  off = v->off + (a - v->addr);
+  if(v->f == 0){
+    if((mem = kalloc_evict(1)) == 0)
+      return -1;
+  } else if((v->prot & PROT_WRITE) == 0){
+    // Nobody can write the page: share the cached copy.
+    ilockshared(v->f->ip);
+    mem = pcacheget(v->f->ip, off);
+    iunlockshared(v->f->ip);
+    if(mem == 0)
+      return -1;
+  } else {
+    if((mem = kalloc_evict(0)) == 0)
+      return -1;
+    ilockshared(v->f->ip);
+    n = readi(v->f->ip, mem, off, PGSIZE);
+    iunlockshared(v->f->ip);
+    if(n < 0)
+      n = 0;
+    memset(mem + n, 0, PGSIZE - n);
+  }
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(mappages(vm->pgdir, (char*)a, PGSIZE, V2P(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Give child a copy of parent's regions, at fork.
+// Pages that parent has already touched are shared for
+// MAP_SHARED and read-only regions and copied for other
+// MAP_PRIVATE ones.
+// Returns 0 on success, -1 if memory runs out.
+int
+vmacopy(struct vmspace *child, struct vmspace *parent)
+{
+  struct vma *v;
+  uint a, pa, flags;
+  char *mem;
+
+  for(v = parent->vma; v < &parent->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    child->vma[v - parent->vma] = *v;
+    if(v->f)
+      filedup(v->f);
+    for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+      if((mem = uva2ka(parent->pgdir, (char*)a)) == 0)
+        continue;
+      pa = V2P(mem);
+      flags = PTE_U | ((v->prot & PROT_WRITE) ? PTE_W : 0);
+      if((v->flags & MAP_SHARED) || (v->prot & PROT_WRITE) == 0){
+        kincref(mem);
+      } else {
+        if((mem = kalloc_evict(0)) == 0)
+          return -1;
+        memmove(mem, P2V(pa), PGSIZE);
+        pa = V2P(mem);
+      }
+      if(mappages(child->pgdir, (char*)a, PGSIZE, pa, flags) < 0){
+        kfree(mem);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+// Forget all of vm's regions, closing mapped files.
+// The pages themselves are freed with vm's page table.
+void
+vmafree(struct vmspace *vm)
+{
+  struct vma *v;
+
+  for(v = vm->vma; v < &vm->vma[NVMA]; v++){
+    if(v->f)
+      fileclose(v->f);
+    memset(v, 0, sizeof(*v));
+  }
+}
+
+// Remove [addr, addr+len) from vm's regions, freeing any pages
+// in it and shooting them down from every TLB (see uvmunmap).
+// A region that is only partly covered is shrunk, or
+// split in two if the hole is in its middle.
+// Returns 0 on success, -1 if a split needs a free slot
+// and there is none. Caller must hold vm->lock.
+static int
+unmaprange(struct vmspace *vm, uint addr, uint len)
+{
+  struct vma *v, *nv;
+  uint start, end;
+
+  for(v = vm->vma; v < &vm->vma[NVMA]; v++){
+    if(v->len == 0 || addr >= v->addr + v->len || v->addr >= addr + len)
+      continue;
+    start = addr > v->addr ? addr : v->addr;
+    end = addr + len < v->addr + v->len ? addr + len : v->addr + v->len;
+
+    if(start > v->addr && end < v->addr + v->len){
+      // Hole in the middle: the tail becomes a new region.
+      for(nv = vm->vma; nv < &vm->vma[NVMA]; nv++)
+        if(nv->len == 0)
+          break;
+      if(nv == &vm->vma[NVMA])
+        return -1;
+      *nv = *v;
+      nv->addr = end;
+      nv->len = v->addr + v->len - end;
+      nv->off = v->off + (end - v->addr);
+      if(nv->f)
+        filedup(nv->f);
+      v->len = start - v->addr;
+    } else if(start > v->addr){
+      v->len = start - v->addr;
+    } else if(end < v->addr + v->len){
+      v->off += end - v->addr;
+      v->len -= end - v->addr;
+      v->addr = end;
+    } else {
+      if(v->f)
+        fileclose(v->f);
+      memset(v, 0, sizeof(*v));
+    }
+    uvmunmap(vm, start, end);
+  }
+  return 0;
+}
+
+// Map the n pages in pages[] as a new shared, writable region
+// of the current process, taking over the caller's reference
+// to each page. Used to attach shared memory (see shm.c).
+// Returns the address of the region, or -1 (dropping the
+// references) if there is no room.
+int
+vmaattach(char **pages, int n)
+{
+  struct proc *curproc = myproc();
+  struct vmspace *vm = curproc->vm;
+  struct vma *v;
+  uint a;
+  int i;
+
+  acquiresleep(&vm->lock);
+  for(v = vm->vma; v < &vm->vma[NVMA]; v++)
+    if(v->len == 0)
+      break;
+  if(v == &vm->vma[NVMA] || (a = mmapaddr(vm, n*PGSIZE)) == 0){
+    releasesleep(&vm->lock);
+    for(i = 0; i < n; i++)
+      kfree(pages[i]);
+    return -1;
+  }
+  v->addr = a;
+  v->len = n*PGSIZE;
+  v->prot = PROT_READ|PROT_WRITE;
+  v->flags = MAP_SHARED|MAP_ANONYMOUS;
+  v->off = 0;
+  v->f = 0;
+  for(i = 0; i < n; i++){
+    if(mappages(vm->pgdir, (char*)a + i*PGSIZE, PGSIZE, V2P(pages[i]),
+                PTE_U|PTE_W) < 0){
+      // unmaprange() drops the references already mapped.
+      for(; i < n; i++)
+        kfree(pages[i]);
+      unmaprange(vm, a, n*PGSIZE);
+      releasesleep(&vm->lock);
+      return -1;
+    }
+  }
+  releasesleep(&vm->lock);
+  return a;
+}
+
+// Remove the region starting at addr from the current process.
+// Returns 0, or -1 if no region starts there or a thread's
+// system call is using it.
+int
+vmadetach(uint addr)
+{
+  struct proc *curproc = myproc();
+  struct vmspace *vm = curproc->vm;
+  struct vma *v;
+  int r;
+
+  acquiresleep(&vm->lock);
+  if((v = findvma(vm, addr)) == 0 || v->addr != addr ||
+     vmpinned(vm, v->addr, v->addr + v->len)){
+    releasesleep(&vm->lock);
+    return -1;
+  }
+  r = unmaprange(vm, v->addr, v->len);
+  releasesleep(&vm->lock);
+  return r;
+}
+
+// void *mmap(void *addr, uint len, int prot, int flags, int fd, int off)
+// addr is only a hint and is ignored.
+int
+sys_mmap(void)
+{
+  struct proc *curproc = myproc();
+  struct vmspace *vm = curproc->vm;
+  struct vma *v;
+  struct file *f;
+  int addr, len, prot, flags, fd, off;
+  uint a, va;
+  char *mem;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &prot) < 0 ||
+     argint(3, &flags) < 0 || argint(4, &fd) < 0 || argint(5, &off) < 0)
+    return -1;
+  if(len <= 0 || off < 0 || off % PGSIZE != 0)
+    return -1;
+  if(((flags & MAP_SHARED) != 0) == ((flags & MAP_PRIVATE) != 0))
+    return -1;
+
+  f = 0;
+  if((flags & MAP_ANONYMOUS) == 0){
+    if((f = fdget(fd)) == 0)
+      return -1;
+    if(f->type != FD_INODE || f->ip->type != T_FILE || !f->readable)
+      return -1;
+    // Shared file mappings are read-only: writes would have
+    // to find their way back to the file.
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE))
+      return -1;
+  }
+
+  acquiresleep(&vm->lock);
+  for(v = vm->vma; v < &vm->vma[NVMA]; v++)
+    if(v->len == 0)
+      break;
+  len = PGROUNDUP(len);
+  if(v == &vm->vma[NVMA] || (a = mmapaddr(vm, len)) == 0){
+    releasesleep(&vm->lock);
+    return -1;
+  }
+
+  v->addr = a;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = f ? filedup(f) : 0;
+
+  // Shared anonymous memory must exist before a fork()
+  // for parent and child to end up with the same pages.
+  if(f == 0 && (flags & MAP_SHARED)){
+    for(va = a; va < a + len; va += PGSIZE){
+      if((mem = kalloc_evict(1)) == 0 ||
+         mappages(vm->pgdir, (char*)va, PGSIZE, V2P(mem),
+                  PTE_U | ((prot & PROT_WRITE) ? PTE_W : 0)) < 0){
+        if(mem)
+          kfree(mem);
+        unmaprange(vm, a, len);
+        releasesleep(&vm->lock);
+        return -1;
+      }
+    }
+  }
+  releasesleep(&vm->lock);
+  return a;
+}
+
+// int munmap(void *addr, uint len)
+// Fails while a thread's system call is using part of the range.
+int
+sys_munmap(void)
+{
+  struct proc *curproc = myproc();
+  int addr, len, r;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  if((uint)addr % PGSIZE != 0 || len <= 0)
+    return -1;
+  if((uint)addr < MMAPBASE || (uint)addr + len > MMAPTOP ||
+     (uint)addr + len < (uint)addr)
+    return -1;
+  acquiresleep(&curproc->vm->lock);
+  if(vmpinned(curproc->vm, addr, addr + PGROUNDUP(len)))
+    r = -1;
+  else
+    r = unmaprange(curproc->vm, addr, PGROUNDUP(len));
+  releasesleep(&curproc->vm->lock);
+  return r;
+}
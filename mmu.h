@@ -2,6 +2,7 @@
 // x86 memory management unit (MMU).
 
 // Eflags register
+#define FL_TF           0x00000100      // Trap Flag
 #define FL_IF           0x00000200      // Interrupt Enable
 
 // Control Register flags
@@ -11,6 +12,16 @@
 
 #define CR4_PSE         0x00000010      // Page size extension
 
+// Model-specific registers for sysenter
+#define MSR_SYSENTER_CS  0x174          // Kernel code segment
+#define MSR_SYSENTER_ESP 0x175          // Kernel stack pointer
+#define MSR_SYSENTER_EIP 0x176          // Kernel entry point
+
+// Page fault error code bits
+#define FEC_PR          0x1             // Fault caused by protection violation
+#define FEC_WR          0x2             // Fault caused by a write
+#define FEC_U           0x4             // Fault occurred in user mode
+
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
@@ -94,7 +105,9 @@ struct segdesc {
 #define PTE_P           0x001   // Present
 #define PTE_W           0x002   // Writeable
 #define PTE_U           0x004   // User
+#define PTE_A           0x020   // Accessed
 #define PTE_PS          0x080   // Page Size
+#define PTE_SWAP        0x200   // Not present: swapped out (software bit)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
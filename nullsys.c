@@ -0,0 +1,52 @@
+// Null system call benchmark: time getpid() read from the vdso
+// page, as ulib.c's getpid() does, entered through sysenter, as
+// the stubs in usys.S do, and entered through the
+// int $T_SYSCALL gate, and print the cycles per call.
+//
+// usage: nullsys [n]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "syscall.h"
+#include "traps.h"
+
+static int
+intgetpid(void)
+{
+  int pid;
+
+  asm volatile("int %1" : "=a" (pid) : "i" (T_SYSCALL), "0" (SYS_getpid) :
+               "memory");
+  return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n;
+  uint t0, t1, t2, t3;
+
+  n = argc > 1 ? atoi(argv[1]) : 100000;
+  if(n <= 0)
+    n = 1;
+
+  // Cycle counts are kept to 32 bits: there is no 64-bit
+  // division in user space, and n calls take well under 2^32.
+  t0 = (uint)rdtsc();
+  for(i = 0; i < n; i++)
+    getpid();
+  t1 = (uint)rdtsc();
+  for(i = 0; i < n; i++)
+    sysgetpid();
+  t2 = (uint)rdtsc();
+  for(i = 0; i < n; i++)
+    intgetpid();
+  t3 = (uint)rdtsc();
+
+  printf(1, "vdso: %d cycles per call\n", (t1 - t0) / n);
+  printf(1, "sysenter: %d cycles per call\n", (t2 - t1) / n);
+  printf(1, "int $%d: %d cycles per call\n", T_SYSCALL, (t3 - t2) / n);
+  exit();
+}
@@ -2,7 +2,12 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
+#define NVMA         16  // mapped regions per process
+#define NPIN          4  // user ranges pinned by one system call
 #define NFILE       100  // open files per system
+#define PIPEPAGES     4  // pages of buffer per pipe
+#define NSHM         16  // shared memory segments per system
+#define SHMPAGES     64  // maximum pages in a shared memory segment
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
@@ -10,5 +15,11 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NCPAGE     1024  // size of file page cache in pages
 #define FSSIZE       1000  // size of file system in blocks
+#define NSWAP        4096  // pages of swap space, after the file system
+#define SWAPSIZE     (NSWAP*8)  // size of swap space in blocks
+#define NZEROPG      256  // pages kept zeroed by idle CPUs
+#define NLATBUCKET    32  // buckets in a log2 latency histogram
+#define NLOCKCLASS    64  // lock names tracked by lockstat()
 
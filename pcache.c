@@ -0,0 +1,207 @@
+// Page cache.
+//
+// File data is cached in 4096-byte pages, apart from the
+// buffer cache (bio.c), which is left to metadata and the log,
+// so that metadata churn cannot push hot file contents out.
+// readi() reads file data through this cache, exec() maps the
+// read-only segments of a program straight out of it, and
+// read-only file mmap()s share its pages.
+//
+// Pages are identified by device, inode number and page-aligned
+// file offset, so they outlive the in-memory inode. A page holds
+// the file's data at that offset, followed by zeros past the end
+// of the file. The cache holds one reference to each page (see
+// kincref in kalloc.c); every page table that maps the page
+// holds another. Evicting an entry just drops the cache's
+// reference, leaving the page to the processes still using it.
+//
+// writei() still sends data to disk through the log, and then
+// updates the cached pages in place (pcachewrite). A page that
+// is mapped somewhere is dropped from the cache instead, so
+// that the mappings keep the contents they started with.
+// Truncating a file drops all its pages (pcacheinval).
+//
+// Lookups go through a hash table; replacement is LRU. When
+// memory runs short, kalloc_evict() takes unmapped pages back
+// from the cache (pcachereclaim) before it swaps.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NHASH 251
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint off;             // file offset of the page
+  char *mem;            // the page, or 0 if the entry is free
+  uint lastuse;         // for LRU replacement
+  struct cpage *next;   // hash chain
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NCPAGE];
+  struct cpage *hash[NHASH];
+  uint clock;
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+static struct cpage**
+bucket(uint dev, uint inum, uint off)
+{
+  return &pcache.hash[(dev*31 + inum*17 + off/PGSIZE) % NHASH];
+}
+
+// Look for a cached page. Must hold pcache.lock.
+static struct cpage*
+pcachefind(uint dev, uint inum, uint off)
+{
+  struct cpage *c;
+
+  for(c = *bucket(dev, inum, off); c; c = c->next)
+    if(c->dev == dev && c->inum == inum && c->off == off)
+      return c;
+  return 0;
+}
+
+// Remove c from the cache. Must hold pcache.lock.
+static void
+pcachedrop(struct cpage *c)
+{
+  struct cpage **pp;
+
+  for(pp = bucket(c->dev, c->inum, c->off); *pp != c; pp = &(*pp)->next)
+    ;
+  *pp = c->next;
+  kfree(c->mem);
+  c->mem = 0;
+}
+
+// Return the page holding ip's data at off, which must be
+// page-aligned, reading it in if it is not cached.
+// The caller gets its own reference to the page, which it must
+// drop with kfree(), and must not write to the page.
+// Caller must hold ip->lock, shared or exclusive.
+// Returns 0 if memory runs out.
+char*
+pcacheget(struct inode *ip, uint off)
+{
+  struct cpage *c, *victim;
+  char *mem;
+  uint n;
+
+  acquire(&pcache.lock);
+  if((c = pcachefind(ip->dev, ip->inum, off)) != 0){
+    c->lastuse = ++pcache.clock;
+    kincref(c->mem);
+    release(&pcache.lock);
+    return c->mem;
+  }
+  release(&pcache.lock);
+
+  if((mem = kalloc_evict(0)) == 0)
+    return 0;
+  n = off < ip->size ? min(ip->size - off, PGSIZE) : 0;
+  readblocks(ip, mem, off, n);
+  memset(mem + n, 0, PGSIZE - n);
+
+  acquire(&pcache.lock);
+  if((c = pcachefind(ip->dev, ip->inum, off)) != 0){
+    // Another process read the same page meanwhile.
+    c->lastuse = ++pcache.clock;
+    kincref(c->mem);
+    release(&pcache.lock);
+    kfree(mem);
+    return c->mem;
+  }
+  victim = 0;
+  for(c = pcache.page; c < &pcache.page[NCPAGE]; c++){
+    if(c->mem == 0){
+      victim = c;
+      break;
+    }
+    if(victim == 0 || c->lastuse < victim->lastuse)
+      victim = c;
+  }
+  if(victim->mem)
+    pcachedrop(victim);
+  victim->dev = ip->dev;
+  victim->inum = ip->inum;
+  victim->off = off;
+  victim->mem = mem;
+  victim->lastuse = ++pcache.clock;
+  victim->next = *bucket(ip->dev, ip->inum, off);
+  *bucket(ip->dev, ip->inum, off) = victim;
+  kincref(mem);
+  release(&pcache.lock);
+  return mem;
+}
+
+// Bytes [off, off+n) of ip were just overwritten with src.
+// Bring the cached pages up to date.
+// Caller must hold ip->lock.
+void
+pcachewrite(struct inode *ip, char *src, uint off, uint n)
+{
+  struct cpage *c;
+  uint tot, m;
+
+  acquire(&pcache.lock);
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((c = pcachefind(ip->dev, ip->inum, PGROUNDDOWN(off))) == 0)
+      continue;
+    if(krefcount(c->mem) > 1)
+      pcachedrop(c);  // mapped: leave the old page to its users
+    else
+      memmove(c->mem + off%PGSIZE, src, m);
+  }
+  release(&pcache.lock);
+}
+
+// Drop all cached pages of ip.
+void
+pcacheinval(struct inode *ip)
+{
+  struct cpage *c;
+
+  acquire(&pcache.lock);
+  for(c = pcache.page; c < &pcache.page[NCPAGE]; c++)
+    if(c->mem && c->dev == ip->dev && c->inum == ip->inum)
+      pcachedrop(c);
+  release(&pcache.lock);
+}
+
+// Free the least recently used page that nothing else
+// has mapped, because memory is short.
+// Returns 0 if a page was freed, -1 if none could be.
+int
+pcachereclaim(void)
+{
+  struct cpage *c, *victim;
+
+  acquire(&pcache.lock);
+  victim = 0;
+  for(c = pcache.page; c < &pcache.page[NCPAGE]; c++)
+    if(c->mem && (victim == 0 || c->lastuse < victim->lastuse) &&
+       krefcount(c->mem) == 1)
+      victim = c;
+  if(victim)
+    pcachedrop(victim);
+  release(&pcache.lock);
+  return victim ? 0 : -1;
+}
@@ -7,22 +7,47 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
+#include "fcntl.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a ring of PIPEPAGES pages. Data moves
+// in and out of it with memmove(), a page-contiguous piece at
+// a time. Sleepers are woken only when it is worth their while:
+// a reader as soon as there is data, but a writer that found
+// the pipe full only once PIPELOWAT bytes have drained, or
+// fewer if that is enough for some writer to finish.
+#define PIPESIZE (PIPEPAGES*PGSIZE)
+#define PIPELOWAT (PIPESIZE/2)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *buf[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int nreadwait;  // readers asleep waiting for data
+  int nwritewait; // writers asleep waiting for room
+  uint writeneed; // least room that lets a sleeping writer finish
+  struct waitq wq;  // poll() calls waiting for either
 };
 
+static void
+pipefree(struct pipe *p)
+{
+  int i;
+
+  for(i = 0; i < PIPEPAGES; i++)
+    if(p->buf[i])
+      kfree(p->buf[i]);
+  kfree((char*)p);
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
   struct pipe *p;
+  int i;
 
   p = 0;
   *f0 = *f1 = 0;
@@ -30,6 +55,10 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((p = (struct pipe*)kalloc()) == 0)
     goto bad;
+  memset(p, 0, sizeof(*p));
+  for(i = 0; i < PIPEPAGES; i++)
+    if((p->buf[i] = kalloc()) == 0)
+      goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -38,17 +67,19 @@ pipealloc(struct file **f0, struct file **f1)
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
   (*f0)->writable = 0;
+  (*f0)->nonblock = 0;
   (*f0)->pipe = p;
   (*f1)->type = FD_PIPE;
   (*f1)->readable = 0;
   (*f1)->writable = 1;
+  (*f1)->nonblock = 0;
   (*f1)->pipe = p;
   return 0;
 
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    pipefree(p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -67,40 +98,84 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  waitqwake(&p->wq);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    pipefree(p);
   } else
     release(&p->lock);
 }
 
+// Copy n bytes between addr and the buffer at byte offset off,
+// into the buffer if in is set, out of it otherwise.
+static void
+pipecopy(struct pipe *p, uint off, char *addr, int n, int in)
+{
+  char *b;
+  int m;
+
+  while(n > 0){
+    b = p->buf[(off % PIPESIZE) / PGSIZE] + off % PGSIZE;
+    m = PGSIZE - off % PGSIZE;
+    if(m > n)
+      m = n;
+    if(in)
+      memmove(b, addr, m);
+    else
+      memmove(addr, b, m);
+    off += m;
+    addr += m;
+    n -= m;
+  }
+}
+
 //PAGEBREAK: 40
+// If nonblock is set, write what fits and return at once:
+// the count written, or -EAGAIN if the pipe was full.
 int
-pipewrite(struct pipe *p, char *addr, int n)
+pipewrite(struct pipe *p, char *addr, int n, int nonblock)
 {
-  int i;
+  int i, m;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
+  for(i = 0; i < n; i += m){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      if(p->nreadwait)
+        wakeup(&p->nread);
+      waitqwake(&p->wq);
+      if(nonblock){
+        release(&p->lock);
+        return i > 0 ? i : -EAGAIN;
+      }
+      if(p->nwritewait == 0 || n - i < p->writeneed)
+        p->writeneed = n - i;
+      p->nwritewait++;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
+      p->nwritewait--;
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    m = PIPESIZE - (p->nwrite - p->nread);
+    if(m > n - i)
+      m = n - i;
+    pipecopy(p, p->nwrite, addr + i, m, 1);
+    p->nwrite += m;
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  if(p->nreadwait)
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  waitqwake(&p->wq);
   release(&p->lock);
   return n;
 }
 
+// If nonblock is set, return -EAGAIN rather than wait
+// for data.
 int
-piperead(struct pipe *p, char *addr, int n)
+piperead(struct pipe *p, char *addr, int n, int nonblock)
 {
-  int i;
+  int m;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -108,14 +183,54 @@ piperead(struct pipe *p, char *addr, int n)
       release(&p->lock);
       return -1;
     }
+    if(nonblock){
+      release(&p->lock);
+      return -EAGAIN;
+    }
+    p->nreadwait++;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
+    p->nreadwait--;
+  }
+  m = p->nwrite - p->nread;  //DOC: piperead-copy
+  if(m > n)
+    m = n;
+  if(m > 0){
+    pipecopy(p, p->nread, addr, m, 0);
+    p->nread += m;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  if(p->nwritewait && (PIPESIZE - (p->nwrite - p->nread) >= PIPELOWAT ||
+                       PIPESIZE - (p->nwrite - p->nread) >= p->writeneed)){
+    // All wake up; those that sleep again say what they need.
+    p->writeneed = PIPELOWAT;
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  }
+  if(m > 0)
+    waitqwake(&p->wq);
+  release(&p->lock);
+  return m;
+}
+
+// Report whether p is ready for reading, or for writing if
+// writable is set, after putting pw on its queue.
+int
+pipepoll(struct pipe *p, int writable, struct pollwait *pw)
+{
+  int r;
+
+  pollwait(&p->wq, pw);
+  r = 0;
+  acquire(&p->lock);
+  if(writable){
+    if(p->readopen == 0)
+      r |= POLLERR;
+    else if(p->nwrite != p->nread + PIPESIZE)
+      r |= POLLOUT;
+  } else {
+    if(p->nread != p->nwrite)
+      r |= POLLIN;
+    if(p->writeopen == 0)
+      r |= POLLHUP;
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
-  return i;
+  return r;
 }
@@ -0,0 +1,100 @@
+// Pipe benchmark: stream data through a pipe to a child, and
+// bounce a one-byte message back and forth between two
+// processes over a pair of pipes, printing the cycles taken.
+//
+// usage: pipebench [kbytes [rounds]]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+char buf[8192];
+
+void
+fail(char *s)
+{
+  printf(2, "pipebench: %s\n", s);
+  exit();
+}
+
+// Write kb KB to a child that reads it all.
+void
+stream(int kb)
+{
+  int fds[2], pid, n, tot;
+  uint t0, t1;
+
+  if(pipe(fds) < 0)
+    fail("pipe failed");
+  t0 = (uint)rdtsc();
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    close(fds[1]);
+    tot = 0;
+    while((n = read(fds[0], buf, sizeof(buf))) > 0)
+      tot += n;
+    if(tot != kb*1024)
+      fail("short read");
+    exit();
+  }
+  close(fds[0]);
+  for(n = 0; n < kb; n += sizeof(buf)/1024)
+    if(write(fds[1], buf, sizeof(buf)) != sizeof(buf))
+      fail("write failed");
+  close(fds[1]);
+  wait();
+  t1 = (uint)rdtsc();
+  printf(1, "stream: %d KB in %d cycles, %d cycles per KB\n",
+         kb, t1 - t0, (t1 - t0) / kb);
+}
+
+// Bounce one byte back and forth n times.
+void
+pingpong(int n)
+{
+  int ping[2], pong[2], pid, i;
+  uint t0, t1;
+  char c;
+
+  if(pipe(ping) < 0 || pipe(pong) < 0)
+    fail("pipe failed");
+  if((pid = fork()) < 0)
+    fail("fork failed");
+  if(pid == 0){
+    for(i = 0; i < n; i++){
+      if(read(ping[0], &c, 1) != 1 || write(pong[1], &c, 1) != 1)
+        fail("pong failed");
+    }
+    exit();
+  }
+  t0 = (uint)rdtsc();
+  for(i = 0; i < n; i++){
+    if(write(ping[1], "x", 1) != 1 || read(pong[0], &c, 1) != 1)
+      fail("ping failed");
+  }
+  t1 = (uint)rdtsc();
+  wait();
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+  printf(1, "ping-pong: %d rounds, %d cycles per round\n",
+         n, (t1 - t0) / n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kb, rounds;
+
+  kb = argc > 1 ? atoi(argv[1]) : 4096;
+  rounds = argc > 2 ? atoi(argv[2]) : 10000;
+  kb = (kb + 7) / 8 * 8;
+  if(kb <= 0 || rounds <= 0)
+    fail("usage: pipebench [kbytes [rounds]]");
+  stream(kb);
+  pingpong(rounds);
+  exit();
+}
@@ -0,0 +1,14 @@
+// Interface for poll().
+// Both the kernel and user programs use this header file.
+
+#define POLLIN   0x1   // data to read, or reading would not block
+#define POLLOUT  0x4   // writing would not block
+#define POLLERR  0x8   // pipe with no reader left (revents only)
+#define POLLHUP  0x10  // pipe with no writer left (revents only)
+#define POLLNVAL 0x20  // fd is not open (revents only)
+
+struct pollfd {
+  int fd;
+  short events;   // POLLIN, POLLOUT
+  short revents;  // set by poll()
+};
@@ -4,8 +4,13 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
+#include "fs.h"
+#include "file.h"
 
 struct {
   struct spinlock lock;
@@ -65,6 +70,39 @@ myproc(void) {
   return p;
 }
 
+// Make p runnable, and if some other CPU is halted for want of
+// work, send it an IPI to come and run p (see scheduler).
+// Must hold ptable.lock.
+static void
+ready(struct proc *p)
+{
+  struct cpu *c;
+
+  p->state = RUNNABLE;
+  for(c = cpus; c < &cpus[ncpu]; c++){
+    if(c->idle && c != mycpu()){
+      c->idle = 0;
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+      break;
+    }
+  }
+}
+
+// Mark p's slot UNUSED, for allocproc() to reuse.
+// Called through call_rcu() once a process is gone, so that
+// kill(), which looks for pids without taking ptable.lock,
+// never sees the slot change hands under it.
+static void
+procfree(void *arg)
+{
+  struct proc *p = arg;
+
+  acquire(&ptable.lock);
+  p->killed = 0;
+  p->state = UNUSED;
+  release(&ptable.lock);
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -88,12 +126,17 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->vm = 0;
+  p->fdt = 0;
+  p->npin = 0;
+  p->nhold = 0;
 
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    p->pid = 0;
+    call_rcu(&p->rcu, procfree, p);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -115,6 +158,25 @@ found:
   return p;
 }
 
+// Give back a process from allocproc() that fork() or
+// clone() could not finish setting up.
+static void
+procabort(struct proc *p)
+{
+  if(p->vm){
+    vmspaceput(p->vm);
+    p->vm = 0;
+  }
+  if(p->fdt){
+    fdtableput(p->fdt);
+    p->fdt = 0;
+  }
+  kfree(p->kstack);
+  p->kstack = 0;
+  p->pid = 0;
+  call_rcu(&p->rcu, procfree, p);
+}
+
 //PAGEBREAK: 32
 // Set up first user process.
 void
@@ -126,10 +188,11 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->vm = vmspacealloc()) == 0 || (p->vm->pgdir = setupkvm()) == 0 ||
+     vdsomap(p->vm->pgdir, p->pid) < 0)
     panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  inituvm(p->vm->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  p->vm->sz = PGSIZE;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -140,7 +203,9 @@ userinit(void)
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  if((p->fdt = fdtablealloc()) == 0)
+    panic("userinit: no fdtable");
+  p->fdt->cwd = namei("/");
 
   // this assignment to p->state lets other cores
   // run this process. the acquire forces the above
@@ -154,24 +219,39 @@ userinit(void)
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size on success, -1 on failure, which
+// includes shrinking memory a thread's system call is using.
+// Sizes stay below MMAPBASE, so never look negative.
 int
 growproc(int n)
 {
-  uint sz;
+  uint sz, oldsz;
   struct proc *curproc = myproc();
+  struct vmspace *vm = curproc->vm;
 
-  sz = curproc->sz;
+  acquiresleep(&vm->lock);
+  sz = oldsz = vm->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n > MMAPBASE || sz + n < sz ||
+       (sz = allocuvm(vm->pgdir, sz, sz + n)) == 0){
+      releasesleep(&vm->lock);
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n > sz){
+      releasesleep(&vm->lock);
+      return -1;
+    }
+    sz += n;
+    if(vmpinned(vm, sz, oldsz)){
+      releasesleep(&vm->lock);
       return -1;
+    }
+    uvmunmap(vm, sz, oldsz);
   }
-  curproc->sz = sz;
-  switchuvm(curproc);
-  return 0;
+  vm->sz = sz;
+  releasesleep(&vm->lock);
+  return oldsz;
 }
 
 // Create a new process copying p as the parent.
@@ -180,7 +260,7 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *curproc = myproc();
 
@@ -189,24 +269,78 @@ fork(void)
     return -1;
   }
 
-  // Copy process state from proc.
-  if((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+  // Copy process state from proc. The lock keeps other
+  // threads from changing the address space meanwhile.
+  if((np->vm = vmspacealloc()) == 0){
+    procabort(np);
+    return -1;
+  }
+  acquiresleep(&curproc->vm->lock);
+  if((np->vm->pgdir = copyuvm(curproc->vm->pgdir, curproc->vm->sz)) == 0 ||
+     vmacopy(np->vm, curproc->vm) < 0){
+    releasesleep(&curproc->vm->lock);
+    procabort(np);
+    return -1;
+  }
+  np->vm->sz = curproc->vm->sz;
+  releasesleep(&curproc->vm->lock);
+  if(vdsomap(np->vm->pgdir, np->pid) < 0 ||
+     (np->fdt = fdtablecopy(curproc->fdt)) == 0){
+    procabort(np);
     return -1;
   }
-  np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(curproc->ofile[i])
-      np->ofile[i] = filedup(curproc->ofile[i]);
-  np->cwd = idup(curproc->cwd);
+  safestrcpy(np->name, curproc->name, sizeof(curproc->name));
+
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+
+  ready(np);
+
+  release(&ptable.lock);
+
+  return pid;
+}
+
+// Create a new thread of the current process: a process that
+// shares its address space and starts in fn(arg), on the
+// stack whose top is stack. If fn returns, it returns to an
+// invalid address; it should call exit() instead.
+// Open files and the current directory are shared too.
+// Returns the new thread's pid, or -1.
+int
+clone(uint fn, uint arg, uint stack)
+{
+  int pid;
+  uint sp, ustack[2];
+  struct proc *np;
+  struct proc *curproc = myproc();
+
+  // Push arg and a fake return PC where fn expects them,
+  // making sure the page is present.
+  sp = stack - sizeof(ustack);
+  if(stack % 4 != 0 || uvmcheck(sp, sizeof(ustack), 1) < 0)
+    return -1;
+  ustack[0] = 0xffffffff;
+  ustack[1] = arg;
+  if(copyout(curproc->vm->pgdir, sp, ustack, sizeof(ustack)) < 0)
+    return -1;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  np->vm = vmspacedup(curproc->vm);
+  np->fdt = fdtabledup(curproc->fdt);
+  vdsothreaded(np->vm->pgdir);
+  np->parent = curproc;
+  *np->tf = *curproc->tf;
+  np->tf->eip = fn;
+  np->tf->esp = sp;
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -214,7 +348,7 @@ fork(void)
 
   acquire(&ptable.lock);
 
-  np->state = RUNNABLE;
+  ready(np);
 
   release(&ptable.lock);
 
@@ -229,23 +363,14 @@ exit(void)
 {
   struct proc *curproc = myproc();
   struct proc *p;
-  int fd;
 
   if(curproc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd]){
-      fileclose(curproc->ofile[fd]);
-      curproc->ofile[fd] = 0;
-    }
-  }
-
-  begin_op();
-  iput(curproc->cwd);
-  end_op();
-  curproc->cwd = 0;
+  // Close all open files, unless other threads still use them.
+  fdrelease();
+  fdtableput(curproc->fdt);
+  curproc->fdt = 0;
 
   acquire(&ptable.lock);
 
@@ -267,12 +392,35 @@ exit(void)
   panic("zombie exit");
 }
 
+// Free the zombie p's kernel stack and its slot, and return
+// its address space, for the caller to vmspaceput() once it
+// has released ptable.lock: that may sleep.
+// Must hold ptable.lock.
+static struct vmspace*
+reap(struct proc *p)
+{
+  struct vmspace *vm;
+
+  vm = p->vm;
+  p->vm = 0;
+  kfree(p->kstack);
+  p->kstack = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  call_rcu(&p->rcu, procfree, p);
+  return vm;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+// Threads this process created are not its children
+// here; see join().
 int
 wait(void)
 {
   struct proc *p;
+  struct vmspace *vm;
   int havekids, pid;
   struct proc *curproc = myproc();
   
@@ -281,21 +429,15 @@ wait(void)
     // Scan through table looking for exited children.
     havekids = 0;
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != curproc)
+      if(p->parent != curproc || p->vm == curproc->vm)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
+        vm = reap(p);
         release(&ptable.lock);
+        vmspaceput(vm);
         return pid;
       }
     }
@@ -311,6 +453,39 @@ wait(void)
   }
 }
 
+// Wait for the thread tid, which this process created with
+// clone(), to exit. Returns tid, or -1 if there is no
+// such thread.
+int
+join(int tid)
+{
+  struct proc *p;
+  struct vmspace *vm;
+  int found;
+  struct proc *curproc = myproc();
+
+  acquire(&ptable.lock);
+  for(;;){
+    found = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      if(p->pid != tid || p->parent != curproc || p->vm != curproc->vm)
+        continue;
+      found = 1;
+      if(p->state == ZOMBIE){
+        vm = reap(p);
+        release(&ptable.lock);
+        vmspaceput(vm);
+        return tid;
+      }
+    }
+    if(!found || curproc->killed){
+      release(&ptable.lock);
+      return -1;
+    }
+    sleep(curproc, &ptable.lock);
+  }
+}
+
 //PAGEBREAK: 42
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
@@ -324,6 +499,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -331,10 +507,12 @@ scheduler(void)
     sti();
 
     // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
         continue;
+      ran = 1;
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -345,6 +523,7 @@ scheduler(void)
 
       swtch(&(c->scheduler), p->context);
       switchkvm();
+      c->vm = 0;
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
@@ -352,6 +531,39 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Between processes, holding no locks: a quiescent state.
+    rcuquiescent();
+
+    // Nothing to run: use the time to refill the pool
+    // of zeroed pages, one page per pass so that a newly
+    // runnable process is noticed quickly.
+    if(ran || kzeroidle())
+      continue;
+
+    // Nothing to do at all: halt until an interrupt, with the
+    // clock tick stopped (see timer.c) and without holding up
+    // RCU grace periods. Look once more with interrupts off
+    // and c->idle set, so that a process made runnable after
+    // the look gets this CPU an IPI from ready(), which the
+    // hlt does not miss.
+    rcuidle(1);
+    cli();
+    acquire(&ptable.lock);
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+      if(p->state == RUNNABLE)
+        break;
+    c->idle = p == &ptable.proc[NPROC];
+    release(&ptable.lock);
+    if(c->idle){
+      timeridle();
+      stihlt();
+      cli();
+      timerwake();
+      acquire(&ptable.lock);
+      c->idle = 0;
+      release(&ptable.lock);
+    }
+    rcuidle(0);
   }
 }
 
@@ -407,6 +619,7 @@ forkret(void)
     first = 0;
     iinit(ROOTDEV);
     initlog(ROOTDEV);
+    swapinit(ROOTDEV);
   }
 
   // Return to "caller", actually trapret (see allocproc).
@@ -461,7 +674,7 @@ wakeup1(void *chan)
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
     if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+      ready(p);
 }
 
 // Wake up all processes sleeping on chan.
@@ -473,29 +686,167 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake up at most n processes sleeping on chan.
+// Returns the number woken.
+int
+wakeupn(void *chan, int n)
+{
+  struct proc *p;
+  int woken;
+
+  woken = 0;
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && woken < n; p++){
+    if(p->state == SLEEPING && p->chan == chan){
+      ready(p);
+      woken++;
+    }
+  }
+  release(&ptable.lock);
+  return woken;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
+// The search takes no lock: a slot whose process has been
+// reaped is not reused until the read-side section ends (see
+// procfree), so the slot found still belongs to pid, or to its
+// zombie, which ignores killed.
 int
 kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
+  if(pid <= 0)
+    return -1;
+  rcu_read_lock();
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
+    if(p->pid == pid && p->state != UNUSED){
       p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      // Wake process from sleep if necessary. The lock makes
+      // sure it cannot be on its way to sleep having checked
+      // killed already.
+      acquire(&ptable.lock);
+      if(p->pid == pid && p->state == SLEEPING)
+        ready(p);
       release(&ptable.lock);
+      rcu_read_unlock();
       return 0;
     }
   }
-  release(&ptable.lock);
+  rcu_read_unlock();
   return -1;
 }
 
+// Is any of [start, end) of vm in use by the current system
+// call of one of its threads? Must hold ptable.lock.
+static int
+pinned(struct vmspace *vm, uint start, uint end)
+{
+  struct proc *p;
+  int i;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->vm != vm)
+      continue;
+    for(i = 0; i < p->npin; i++)
+      if(end > p->pinstart[i] && start < p->pinend[i])
+        return 1;
+  }
+  return 0;
+}
+
+// pinned() for callers about to unmap [start, end) of vm: a
+// thread blocked in a system call (say read() into a buffer)
+// will still touch the memory it checked with uvmcheck().
+// Caller must hold vm->lock, which uvmcheck() takes after
+// pinning, so no new pin can slip past the unmapping.
+int
+vmpinned(struct vmspace *vm, uint start, uint end)
+{
+  int r;
+
+  acquire(&ptable.lock);
+  r = pinned(vm, start, end);
+  release(&ptable.lock);
+  return r;
+}
+
+// Does a CPU have vm's page table loaded?
+// Must hold ptable.lock.
+static int
+vmrunning(struct vmspace *vm)
+{
+  struct proc *p;
+
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->vm == vm && p->state == RUNNING)
+      return 1;
+  return 0;
+}
+
+// Choose a user page to swap out and replace its PTE with
+// swapent, which names the swap slot the page will go to.
+// Returns the page, which the caller must write to swap and
+// then free, or 0 if there is nothing to swap out.
+//
+// Pages are chosen by the clock (second chance) algorithm:
+// a hand sweeps over the pages of all processes, and a page
+// that was accessed since the hand last passed gets its
+// accessed bit cleared instead of being evicted.
+//
+// Only writable pages below the sbrk() size are candidates,
+// which are private to the address space, and only of address
+// spaces that no thread is running in, so that no CPU has the
+// page table loaded and no TLB holds the old PTE. Pages that
+// a thread's current system call is using are pinned (see
+// uvmcheck in vm.c) and skipped.
+char*
+evictpage(uint swapent)
+{
+  static struct proc *p = ptable.proc;  // the clock hand
+  static uint va;
+  pte_t *pte;
+  char *mem;
+  int i;
+
+  acquire(&ptable.lock);
+  // Two trips around clear every accessed bit on the way.
+  for(i = 0; i < 2*NPROC+1; i++){
+    if((p->state == SLEEPING || p->state == RUNNABLE) && !vmrunning(p->vm)){
+      for(; va < p->vm->sz; va += PGSIZE){
+        if((pte = walkpgdir(p->vm->pgdir, (char*)va, 0)) == 0){
+          va = PGADDR(PDX(va) + 1, 0, 0) - PGSIZE;
+          continue;
+        }
+        if((*pte & (PTE_P|PTE_U|PTE_W)) != (PTE_P|PTE_U|PTE_W))
+          continue;
+        if(pinned(p->vm, va, va + PGSIZE))
+          continue;
+        // A futex is keyed by its page's physical address
+        // (see futex.c); never move a page someone else holds.
+        if(krefcount(P2V(PTE_ADDR(*pte))) > 1)
+          continue;
+        if(*pte & PTE_A){
+          *pte &= ~PTE_A;
+          continue;
+        }
+        mem = P2V(PTE_ADDR(*pte));
+        *pte = swapent | PTE_SWAP | PTE_U | PTE_W;
+        va += PGSIZE;
+        release(&ptable.lock);
+        return mem;
+      }
+    }
+    va = 0;
+    if(++p == &ptable.proc[NPROC])
+      p = ptable.proc;
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
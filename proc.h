@@ -8,6 +8,8 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  int idle;                    // Halted in scheduler(); under ptable.lock
+  struct vmspace *vm;          // Address space loaded in %cr3, or 0
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,10 +36,16 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A request to run func(arg) after a grace period (see rcu.c).
+struct rcuhead {
+  struct rcuhead *next;
+  void (*func)(void*);
+  void *arg;
+};
+
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
-  pde_t* pgdir;                // Page table
+  struct vmspace *vm;          // Address space (see vmspace.h)
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
@@ -46,9 +54,14 @@ struct proc {
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct fdtable *fdt;         // Open files and current directory
+  struct file *fhold[NOFILE];  // Files fdget() took references to
+  int nhold;                   //   for the current system call
   char name[16];               // Process name (debugging)
+  uint pinstart[NPIN];         // User memory the current system call
+  uint pinend[NPIN];           //   is using; not to be swapped out
+  int npin;                    // Number of pinned ranges
+  struct rcuhead rcu;          // For freeing the slot (see procfree)
 };
 
 struct rbtree {
@@ -72,3 +85,4 @@ struct node {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+// followed, at MMAPBASE and above, by mmap() regions.
@@ -0,0 +1,135 @@
+// Read-copy-update.
+//
+// Lets a reader look at a shared structure without taking any
+// lock, while writers defer freeing what they remove until no
+// reader can still be looking at it.
+//
+// A reader brackets its lookup with rcu_read_lock() and
+// rcu_read_unlock(), which just turn interrupts off: a CPU in a
+// read-side section cannot be rescheduled, so once every CPU has
+// been through its scheduler loop (a "quiescent state", reported
+// by rcuquiescent()), every reader that was running at some
+// earlier moment has finished. That interval is a grace period.
+// A writer that has unlinked an object calls call_rcu() to have
+// a function run on it after the next full grace period.
+//
+// Read-side sections must be short and must not sleep.
+//
+// Callbacks are collected in rcu.next; when no grace period is
+// running, they move to rcu.cur and one starts, waiting on every
+// CPU that has started. The CPU that reports the last quiescent
+// state runs them, from its scheduler loop, holding no locks.
+//
+// A CPU that halts for want of work (see scheduler) is in a
+// quiescent state for as long as it is halted, so grace periods
+// neither wait for it nor start waiting for it: rcuidle() takes
+// it out of the count, and puts it back when it wakes up.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+struct {
+  struct spinlock lock;
+  struct rcuhead *next;  // waiting for a grace period to start
+  struct rcuhead *cur;   // waiting for the current one to end
+  uint need;             // CPUs yet to pass a quiescent state
+  uint idle;             // CPUs halted in the scheduler
+} rcu;
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+}
+
+void
+rcu_read_lock(void)
+{
+  pushcli();
+}
+
+void
+rcu_read_unlock(void)
+{
+  popcli();
+}
+
+// Start a grace period for the waiting callbacks,
+// unless one is already running. Must hold rcu.lock.
+static void
+rcustart(void)
+{
+  int i;
+
+  if(rcu.cur || rcu.next == 0)
+    return;
+  rcu.cur = rcu.next;
+  rcu.next = 0;
+  rcu.need = 0;
+  for(i = 0; i < ncpu; i++)
+    if(cpus[i].started && (rcu.idle & (1 << i)) == 0)
+      rcu.need |= 1 << i;
+}
+
+// Arrange for func(arg) to be called once every read-side
+// section that might be running now has finished.
+// head is storage for the request, usually embedded in
+// the object being freed.
+void
+call_rcu(struct rcuhead *head, void (*func)(void*), void *arg)
+{
+  head->func = func;
+  head->arg = arg;
+  acquire(&rcu.lock);
+  head->next = rcu.next;
+  rcu.next = head;
+  rcustart();
+  release(&rcu.lock);
+}
+
+// This CPU is in a quiescent state: it holds no locks and
+// is in no read-side section. Called from scheduler().
+void
+rcuquiescent(void)
+{
+  struct rcuhead *done, *h;
+
+  if(rcu.need == 0 && rcu.cur == 0)
+    return;
+
+  done = 0;
+  acquire(&rcu.lock);
+  rcu.need &= ~(1 << cpuid());
+  if(rcu.cur && rcu.need == 0){
+    done = rcu.cur;
+    rcu.cur = 0;
+    rcustart();
+  }
+  release(&rcu.lock);
+
+  while(done){
+    h = done;
+    done = h->next;
+    h->func(h->arg);
+  }
+}
+
+// This CPU is about to halt (idle set), or has woken up.
+// Called from scheduler(), holding no locks.
+void
+rcuidle(int idle)
+{
+  acquire(&rcu.lock);
+  if(idle)
+    rcu.idle |= 1 << cpuid();
+  else
+    rcu.idle &= ~(1 << cpuid());
+  release(&rcu.lock);
+  if(idle)
+    rcuquiescent();
+}
@@ -0,0 +1,38 @@
+// Submission and completion rings for ringenter().
+// Both the kernel and user programs use this header file.
+//
+// A process queues operations in sq[] and calls ringenter(),
+// which carries them out in order and posts their results in
+// cq[], so that a batch of operations costs a single system
+// call. Indices run freely and are taken modulo NRING; a ring
+// is empty when its head equals its tail.
+
+#define NRING 32
+
+// Operations
+#define RING_READ   1   // read(fd, addr, n)
+#define RING_WRITE  2   // write(fd, addr, n)
+#define RING_OPEN   3   // open(addr, n): addr is the path, n the mode
+#define RING_CLOSE  4   // close(fd)
+
+struct ringsqe {
+  int op;
+  int fd;
+  uint addr;
+  int n;
+  uint data;     // Passed through to the completion
+};
+
+struct ringcqe {
+  uint data;
+  int res;       // What the system call would have returned
+};
+
+struct ring {
+  uint sqhead;   // Next operation for the kernel to take
+  uint sqtail;   // Next free entry for the process to fill
+  uint cqhead;   // Next completion for the process to take
+  uint cqtail;   // Next free entry for the kernel to post
+  struct ringsqe sq[NRING];
+  struct ringcqe cq[NRING];
+};
@@ -0,0 +1,169 @@
+// File copy benchmark: copy a file with a plain read()/write()
+// loop, 512 bytes at a time as cat does, and again through a
+// ringenter() ring, a batch of 512-byte reads and then a batch
+// of writes per system call, and print the cycles each took.
+//
+// usage: ringcp [file]
+// Without a file, copies a 64KB file it makes first.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "x86.h"
+#include "ring.h"
+
+#define BSIZE 512
+#define NBATCH (NRING/2)
+
+char buf[NBATCH][BSIZE];
+char cmp[2][BSIZE];
+struct ring ring;
+
+void
+fail(char *s)
+{
+  printf(2, "ringcp: %s\n", s);
+  exit();
+}
+
+// Queue an operation.
+void
+submit(int op, int fd, void *addr, int n, uint data)
+{
+  struct ringsqe *e;
+
+  e = &ring.sq[ring.sqtail % NRING];
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint)addr;
+  e->n = n;
+  e->data = data;
+  ring.sqtail++;
+}
+
+// Carry out the queued operations.
+void
+enter(void)
+{
+  int n;
+
+  n = ring.sqtail - ring.sqhead;
+  if(n > 0 && ringenter(&ring) != n)
+    fail("ringenter failed");
+}
+
+// Take the next completion and return its result.
+int
+result(void)
+{
+  if(ring.cqhead == ring.cqtail)
+    fail("no completion");
+  return ring.cq[ring.cqhead++ % NRING].res;
+}
+
+void
+plaincopy(char *src, char *dst)
+{
+  int in, out, n;
+
+  if((in = open(src, O_RDONLY)) < 0 ||
+     (out = open(dst, O_CREATE|O_WRONLY)) < 0)
+    fail("cannot open");
+  while((n = read(in, buf[0], BSIZE)) > 0)
+    if(write(out, buf[0], n) != n)
+      fail("write failed");
+  close(in);
+  close(out);
+}
+
+void
+ringcopy(char *src, char *dst)
+{
+  int in, out, i, n, eof;
+  int len[NBATCH];
+
+  submit(RING_OPEN, 0, src, O_RDONLY, 0);
+  submit(RING_OPEN, 0, dst, O_CREATE|O_WRONLY, 0);
+  enter();
+  in = result();
+  out = result();
+  if(in < 0 || out < 0)
+    fail("cannot open");
+
+  for(eof = 0; !eof; ){
+    for(i = 0; i < NBATCH; i++)
+      submit(RING_READ, in, buf[i], BSIZE, i);
+    enter();
+    for(i = 0; i < NBATCH; i++)
+      len[i] = result();
+    for(n = 0; n < NBATCH && len[n] > 0; n++)
+      submit(RING_WRITE, out, buf[n], len[n], n);
+    eof = n < NBATCH;
+    enter();
+    for(i = 0; i < n; i++)
+      if(result() != len[i])
+        fail("write failed");
+  }
+
+  submit(RING_CLOSE, in, 0, 0, 0);
+  submit(RING_CLOSE, out, 0, 0, 0);
+  enter();
+  result();
+  result();
+}
+
+// Check that files a and b hold the same bytes.
+void
+same(char *a, char *b)
+{
+  int fa, fb, n, i;
+
+  if((fa = open(a, O_RDONLY)) < 0 || (fb = open(b, O_RDONLY)) < 0)
+    fail("cannot open copy");
+  while((n = read(fa, cmp[0], BSIZE)) > 0){
+    if(read(fb, cmp[1], BSIZE) != n)
+      fail("copies differ");
+    for(i = 0; i < n; i++)
+      if(cmp[0][i] != cmp[1][i])
+        fail("copies differ");
+  }
+  if(read(fb, cmp[1], BSIZE) != 0)
+    fail("copies differ");
+  close(fa);
+  close(fb);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *src;
+  int fd, i;
+  uint t0, t1, t2;
+
+  src = argc > 1 ? argv[1] : "ringcp.in";
+  if(argc <= 1){
+    if((fd = open(src, O_CREATE|O_WRONLY)) < 0)
+      fail("cannot create ringcp.in");
+    for(i = 0; i < BSIZE; i++)
+      buf[0][i] = 'a' + i%26;
+    for(i = 0; i < 128; i++)
+      write(fd, buf[0], BSIZE);
+    close(fd);
+  }
+
+  t0 = (uint)rdtsc();
+  plaincopy(src, "ringcp.out1");
+  t1 = (uint)rdtsc();
+  ringcopy(src, "ringcp.out2");
+  t2 = (uint)rdtsc();
+  same("ringcp.out1", "ringcp.out2");
+
+  printf(1, "read/write: %d cycles\n", t1 - t0);
+  printf(1, "ring: %d cycles\n", t2 - t1);
+  unlink("ringcp.out1");
+  unlink("ringcp.out2");
+  if(argc <= 1)
+    unlink(src);
+  exit();
+}
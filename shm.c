@@ -0,0 +1,162 @@
+// Shared memory segments: shmget(), shmat(), shmdt(), shmctl().
+//
+// A segment is a set of zeroed pages named by a key, which
+// any process can attach to its address space with shmat().
+// The table holds one reference to each page (see kincref in
+// kalloc.c), and every page table the segment is attached to
+// holds another. Attached pages are mapped as a MAP_SHARED
+// region (see vmaattach in mmap.c), so fork() shares them with
+// the child and munmap(), exit() and exec() detach them like
+// any other region.
+//
+// Removing a segment with shmctl(IPC_RMID) frees its slot and
+// key at once and drops the table's references; the pages live
+// on until the last process using them detaches.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
+#include "shm.h"
+
+struct shmseg {
+  int key;                // IPC_PRIVATE if only reachable by id
+  int npages;             // 0 if the slot is free
+  char *pages[SHMPAGES];
+};
+
+struct {
+  struct sleeplock lock;  // held while allocating pages
+  struct shmseg seg[NSHM];
+} shmtable;
+
+void
+shminit(void)
+{
+  initsleeplock(&shmtable.lock, "shm");
+}
+
+// Drop the table's references to s's pages and free the slot.
+// Must hold shmtable.lock.
+static void
+shmfree(struct shmseg *s)
+{
+  int i;
+
+  for(i = 0; i < s->npages; i++)
+    kfree(s->pages[i]);
+  memset(s, 0, sizeof(*s));
+}
+
+// int shmget(int key, uint size, int flags)
+// Return the id of the segment named key, creating one of
+// size bytes if there is none and IPC_CREAT is set.
+int
+sys_shmget(void)
+{
+  struct shmseg *s, *free;
+  int key, size, flags, id, i;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0 || argint(2, &flags) < 0)
+    return -1;
+  if(size <= 0 || size > SHMPAGES*PGSIZE)
+    return -1;
+
+  acquiresleep(&shmtable.lock);
+  free = 0;
+  for(s = shmtable.seg; s < &shmtable.seg[NSHM]; s++){
+    if(s->npages == 0){
+      if(free == 0)
+        free = s;
+    } else if(key != IPC_PRIVATE && s->key == key){
+      id = s - shmtable.seg;
+      releasesleep(&shmtable.lock);
+      if((flags & (IPC_CREAT|IPC_EXCL)) == (IPC_CREAT|IPC_EXCL))
+        return -1;
+      if(PGROUNDUP(size) > s->npages*PGSIZE)
+        return -1;
+      return id;
+    }
+  }
+  if((flags & IPC_CREAT) == 0 || (s = free) == 0){
+    releasesleep(&shmtable.lock);
+    return -1;
+  }
+
+  s->key = key;
+  for(i = 0; i < PGROUNDUP(size)/PGSIZE; i++){
+    if((s->pages[i] = kalloc_evict(1)) == 0){
+      shmfree(s);
+      releasesleep(&shmtable.lock);
+      return -1;
+    }
+    s->npages = i + 1;
+  }
+  id = s - shmtable.seg;
+  releasesleep(&shmtable.lock);
+  return id;
+}
+
+// void *shmat(int id)
+// Attach segment id to the current process and return the
+// address it was attached at.
+int
+sys_shmat(void)
+{
+  struct shmseg *s;
+  char *pages[SHMPAGES];
+  int id, i, n;
+
+  if(argint(0, &id) < 0 || id < 0 || id >= NSHM)
+    return -1;
+  s = &shmtable.seg[id];
+  acquiresleep(&shmtable.lock);
+  if((n = s->npages) == 0){
+    releasesleep(&shmtable.lock);
+    return -1;
+  }
+  for(i = 0; i < n; i++){
+    pages[i] = s->pages[i];
+    kincref(pages[i]);
+  }
+  releasesleep(&shmtable.lock);
+  return vmaattach(pages, n);
+}
+
+// int shmdt(void *addr)
+// Detach the segment attached at addr.
+int
+sys_shmdt(void)
+{
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  return vmadetach(addr);
+}
+
+// int shmctl(int id, int cmd)
+int
+sys_shmctl(void)
+{
+  struct shmseg *s;
+  int id, cmd;
+
+  if(argint(0, &id) < 0 || argint(1, &cmd) < 0)
+    return -1;
+  if(id < 0 || id >= NSHM || cmd != IPC_RMID)
+    return -1;
+  s = &shmtable.seg[id];
+  acquiresleep(&shmtable.lock);
+  if(s->npages == 0){
+    releasesleep(&shmtable.lock);
+    return -1;
+  }
+  shmfree(s);
+  releasesleep(&shmtable.lock);
+  return 0;
+}
@@ -0,0 +1,8 @@
+// Interface for shmget() and shmctl().
+// Both the kernel and user programs use this header file.
+
+#define IPC_PRIVATE  0      // shmget() key: always a new segment
+#define IPC_CREAT    0x200  // shmget(): create the segment if needed
+#define IPC_EXCL     0x400  // shmget(): fail if it already exists
+
+#define IPC_RMID     0      // shmctl(): remove the segment
@@ -16,17 +16,50 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->readers = 0;
+  lk->writers = 0;
+  lk->owner = 0;
   lk->pid = 0;
 }
 
+// If lk is held exclusively by a process that is running
+// (on another CPU, since this one is running us), spin until
+// that changes: the holder will likely release the lock soon,
+// sooner than it takes to sleep and be woken up.
+// Caller must hold lk->lk, which is dropped while spinning.
+// Returns 1 if it spun, 0 if the caller should sleep instead.
+static int
+spinwait(struct sleeplock *lk)
+{
+  struct proc *p;
+
+  // Spinning with interrupts off (lk->lk aside) could hold up
+  // an IPI the owner is waiting for this CPU to take (ipi.c).
+  if(mycpu()->ncli > 1 || !mycpu()->intena)
+    return 0;
+  if(!lk->locked || (p = lk->owner) == 0 || p->state != RUNNING)
+    return 0;
+  release(&lk->lk);
+  while(*(volatile uint*)&lk->locked &&
+        *(struct proc * volatile *)&lk->owner == p &&
+        *(volatile enum procstate*)&p->state == RUNNING)
+    pause();
+  acquire(&lk->lk);
+  return 1;
+}
+
 void
 acquiresleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  lk->writers++;
+  while (lk->locked || lk->readers) {
+    if(!spinwait(lk))
+      sleep(lk, &lk->lk);
   }
+  lk->writers--;
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
   release(&lk->lk);
 }
@@ -36,11 +69,40 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
 }
 
+// Acquire the lock in shared mode, alongside other readers
+// but not while a process holds it exclusively. New readers
+// wait while anyone is waiting for exclusive access, so that
+// a stream of readers cannot starve a writer.
+void
+acquiresleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  while (lk->locked || lk->writers) {
+    if(!spinwait(lk))
+      sleep(lk, &lk->lk);
+  }
+  lk->readers++;
+  release(&lk->lk);
+}
+
+void
+releasesleepshared(struct sleeplock *lk)
+{
+  acquire(&lk->lk);
+  if(lk->readers < 1)
+    panic("releasesleepshared");
+  if(--lk->readers == 0)
+    wakeup(lk);
+  release(&lk->lk);
+}
+
+// Is the lock held exclusively by this process?
 int
 holdingsleep(struct sleeplock *lk)
 {
@@ -51,6 +113,3 @@ holdingsleep(struct sleeplock *lk)
   release(&lk->lk);
   return r;
 }
-
-
-
@@ -1,8 +1,14 @@
 // Long-term locks for processes
+// A sleeplock can be held exclusively by one process, or
+// shared by any number of readers (see acquiresleepshared).
 struct sleeplock {
-  uint locked;       // Is the lock held?
+  uint locked;       // Is the lock held exclusively?
+  int readers;       // Number of processes sharing the lock
+  int writers;       // Number waiting for exclusive access
   struct spinlock lk; // spinlock protecting this sleep lock
   
+  struct proc *owner; // Process holding lock exclusively
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
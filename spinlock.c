@@ -8,29 +8,103 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// Pauses per waiter ahead in line between looks at the lock.
+#define SPINBACKOFF 16
+
+// Contention statistics, for each class of locks that share
+// a name, kept per CPU: a CPU only updates its own counters,
+// while it holds the lock and has interrupts off, so the
+// counters themselves need no locking.
+struct lockclass {
+  char *name;
+  struct lockcpu {
+    uint nacquire;
+    uint ncontend;
+    uint64 spin;
+    uint64 maxhold;
+  } cpu[NCPU];
+};
+
+struct {
+  uint lock;  // taken with xchg; guards adding classes
+  int n;
+  struct lockclass class[NLOCKCLASS];
+} lockstats;
+
+// Find or make the statistics class for locks named name.
+// Returns 0 if the table is full; those locks go uncounted.
+static struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *c;
+  int eflags;
+
+  // Not pushcli(): this runs before mycpu() works.
+  eflags = readeflags();
+  cli();
+  while(xchg(&lockstats.lock, 1) != 0)
+    pause();
+  for(c = lockstats.class; c < &lockstats.class[lockstats.n]; c++)
+    if(strncmp(c->name, name, sizeof(((struct lockstat*)0)->name)) == 0)
+      goto found;
+  c = 0;
+  if(lockstats.n < NLOCKCLASS){
+    c = &lockstats.class[lockstats.n++];
+    c->name = name;
+  }
+found:
+  xchg(&lockstats.lock, 0);
+  if(eflags & FL_IF)
+    sti();
+  return c;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name);
 }
 
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
 // Holding a lock for a long time may cause
 // other CPUs to waste time spinning to acquire it.
+//
+// Each CPU takes a ticket and waits for its number to come
+// up, so the lock goes to waiting CPUs in turn and none can
+// starve. A CPU further back in line pauses longer between
+// looks at the lock, which keeps the cache line holding it
+// from bouncing between all the waiters.
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, ahead, i;
+  int waited;
+  uint64 spin;
+  struct lockcpu *s;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic.
+  ticket = xadd(&lk->next, 1);
+  waited = 0;
+  if(ticket != *(volatile uint*)&lk->owner){
+    waited = 1;
+    spin = rdtsc();
+    while((ahead = ticket - *(volatile uint*)&lk->owner) != 0){
+      for(i = 0; i < ahead * SPINBACKOFF; i++)
+        pause();
+    }
+    spin = rdtsc() - spin;
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +114,35 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+
+  if(lk->class){
+    s = &lk->class->cpu[lk->cpu - cpus];
+    s->nacquire++;
+    if(waited){
+      s->ncontend++;
+      s->spin += spin;
+    }
+  }
+  lk->tacquire = rdtsc();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  struct lockcpu *s;
+  uint64 hold;
+
   if(!holding(lk))
     panic("release");
 
+  if(lk->class){
+    s = &lk->class->cpu[lk->cpu - cpus];
+    hold = rdtsc() - lk->tacquire;
+    if(hold > s->maxhold)
+      s->maxhold = hold;
+  }
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,10 +153,11 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Serve the next ticket, equivalent to lk->owner++.
+  // Only the holder writes owner, so the increment need
+  // not be atomic, but it must be a single store.
+  // A real OS would use C atomics here.
+  asm volatile("incl %0" : "+m" (lk->owner) : );
 
   popcli();
 }
@@ -91,7 +186,7 @@ holding(struct spinlock *lock)
 {
   int r;
   pushcli();
-  r = lock->locked && lock->cpu == mycpu();
+  r = lock->owner != lock->next && lock->cpu == mycpu();
   popcli();
   return r;
 }
@@ -124,3 +219,41 @@ popcli(void)
     sti();
 }
 
+// int lockstat(struct lockstat *st, int n)
+// Copy out the statistics of up to n classes of locks and
+// return the number of classes. If st is 0, clear them all.
+int
+sys_lockstat(void)
+{
+  struct lockstat *st;
+  struct lockclass *c;
+  struct lockcpu *s;
+  int p, n, i;
+
+  if(argint(0, &p) < 0 || argint(1, &n) < 0)
+    return -1;
+  if(p == 0){
+    for(c = lockstats.class; c < &lockstats.class[lockstats.n]; c++)
+      memset(c->cpu, 0, sizeof(c->cpu));
+    return 0;
+  }
+  if(n < 0)
+    return -1;
+  if(n > lockstats.n)
+    n = lockstats.n;
+  if(argwptr(0, (char**)&st, n*sizeof(*st)) < 0)
+    return -1;
+  for(i = 0; i < n; i++, st++){
+    c = &lockstats.class[i];
+    memset(st, 0, sizeof(*st));
+    safestrcpy(st->name, c->name, sizeof(st->name));
+    for(s = c->cpu; s < &c->cpu[NCPU]; s++){
+      st->nacquire += s->nacquire;
+      st->ncontend += s->ncontend;
+      st->spin += s->spin;
+      if(s->maxhold > st->maxhold)
+        st->maxhold = s->maxhold;
+    }
+  }
+  return lockstats.n;
+}
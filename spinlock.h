@@ -1,11 +1,18 @@
 // Mutual exclusion lock.
+// A ticket lock: CPUs get the lock in the order they
+// asked for it (see acquire in spinlock.c).
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket being served; held if owner != next
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For profiling (see lockstat in spinlock.c):
+  struct lockclass *class;  // Statistics for locks with this name
+  uint64 tacquire;   // Time stamp of acquisition
 };
 
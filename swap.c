@@ -0,0 +1,183 @@
+// Swap space.
+//
+// When physical memory runs out and the page cache has nothing
+// left to give back, kalloc_evict() writes a user page to the
+// swap area on the root disk (laid out by mkfs just after the
+// file system) and reuses it. The page is chosen by evictpage()
+// in proc.c. Its PTE is left not present, with
+// PTE_SWAP set and the swap slot number in the address bits:
+//
+//   [ slot | PTE_SWAP | PTE_U | PTE_W ]
+//
+// and the process's next touch of the page faults it back in
+// (see pagefault and uvmcheck in vm.c).
+//
+// Swap I/O goes straight to the disk through a private buffer
+// rather than the buffer cache, so swapped pages do not push
+// file system blocks out of the cache. The buffer's sleep-lock
+// serializes all swap I/O, which also makes sure a page being
+// swapped out is on disk before anyone can try to read it back.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+
+#define SLOT(pte)  (PTE_ADDR(pte) >> PTXSHIFT)
+
+struct {
+  struct spinlock lock;  // protects used[]
+  uint start;            // first block of swap space
+  uint nslot;            // number of slots; 0 if no swap
+  char used[NSWAP];
+  struct buf buf;        // for swap I/O; its lock is held throughout
+} swap;
+
+void
+swapinit(int dev)
+{
+  struct superblock sb;
+
+  initlock(&swap.lock, "swap");
+  initsleeplock(&swap.buf.lock, "swap");
+  readsb(dev, &sb);
+  swap.buf.dev = dev;
+  swap.start = sb.swapstart;
+  swap.nslot = sb.nswap < NSWAP ? sb.nswap : NSWAP;
+  cprintf("swap: %d pages at block %d\n", swap.nslot, swap.start);
+}
+
+static int
+slotalloc(void)
+{
+  int i;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    if(!swap.used[i]){
+      swap.used[i] = 1;
+      release(&swap.lock);
+      return i;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Free the slot of a swapped-out PTE, whose page is no longer
+// needed. Called from freevm(), so it must not sleep.
+void
+swapfree(uint pte)
+{
+  acquire(&swap.lock);
+  if(!swap.used[SLOT(pte)])
+    panic("swapfree");
+  swap.used[SLOT(pte)] = 0;
+  release(&swap.lock);
+}
+
+// Read or write a page from or to a slot.
+// Caller must hold swap.buf.lock.
+static void
+swaprw(uint slot, char *mem, int write)
+{
+  struct buf *b = &swap.buf;
+  int i;
+
+  for(i = 0; i < PGSIZE/BSIZE; i++){
+    b->blockno = swap.start + slot*(PGSIZE/BSIZE) + i;
+    if(write){
+      memmove(b->data, mem + i*BSIZE, BSIZE);
+      b->flags = B_DIRTY;
+    } else
+      b->flags = 0;
+    iderw(b);
+    if(!write)
+      memmove(mem + i*BSIZE, b->data, BSIZE);
+  }
+}
+
+// Swap out one user page and free it.
+// Returns 0 on success, -1 if there is no page to swap out
+// or no room in the swap area.
+static int
+swapout(void)
+{
+  char *mem;
+  int slot;
+
+  if(swap.nslot == 0)
+    return -1;
+  acquiresleep(&swap.buf.lock);
+  if((slot = slotalloc()) < 0){
+    releasesleep(&swap.buf.lock);
+    return -1;
+  }
+  if((mem = evictpage(slot << PTXSHIFT)) == 0){
+    swapfree(slot << PTXSHIFT);
+    releasesleep(&swap.buf.lock);
+    return -1;
+  }
+  swaprw(slot, mem, 1);
+  releasesleep(&swap.buf.lock);
+  kfree(mem);
+  return 0;
+}
+
+// Allocate a page for user memory or the page cache. If
+// physical memory has run out, take back a page from the page
+// cache, or failing that swap out a user page. If zero is set,
+// the page is filled with zeros. Returns 0 if the swap area is
+// full too. May sleep.
+char*
+kalloc_evict(int zero)
+{
+  char *mem;
+
+  for(;;){
+    if((mem = zero ? kalloc_zeroed() : kalloc()) != 0)
+      return mem;
+    if(pcachereclaim() < 0 && swapout() < 0)
+      return 0;
+  }
+}
+
+// Bring the swapped-out page at user address va of pgdir back
+// into memory. Returns 0 on success, -1 if memory runs out.
+int
+swapin(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem;
+  uint slot;
+
+  if((mem = kalloc_evict(0)) == 0)
+    return -1;
+  acquiresleep(&swap.buf.lock);
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & PTE_SWAP) == 0)
+    panic("swapin");
+  slot = SLOT(*pte);
+  swaprw(slot, mem, 0);
+  // Count the page as accessed, so that it is not
+  // swapped straight back out before it is used.
+  *pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_P | PTE_A;
+  releasesleep(&swap.buf.lock);
+  swapfree(slot << PTXSHIFT);
+  return 0;
+}
+
+// Copy the swapped-out page of pte into mem, leaving it
+// in swap. Used by fork() to copy pages it finds swapped out.
+void
+swapread(uint pte, char *mem)
+{
+  acquiresleep(&swap.buf.lock);
+  swaprw(SLOT(pte), mem, 0);
+  releasesleep(&swap.buf.lock);
+}
@@ -7,7 +7,7 @@
 #include "x86.h"
 #include "syscall.h"
 
-// User code makes a system call with INT T_SYSCALL.
+// User code makes a system call with sysenter or INT T_SYSCALL.
 // System call number in %eax.
 // Arguments on the stack, from the user call to the C
 // library system call function. The saved user %esp points
@@ -17,12 +17,7 @@
 int
 fetchint(uint addr, int *ip)
 {
-  struct proc *curproc = myproc();
-
-  if(addr >= curproc->sz || addr+4 > curproc->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  return copyin(ip, addr, sizeof(*ip));
 }
 
 // Fetch the nul-terminated string at addr from the current process.
@@ -32,17 +27,17 @@ int
 fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
-  struct proc *curproc = myproc();
 
-  if(addr >= curproc->sz)
-    return -1;
   *pp = (char*)addr;
-  ep = (char*)curproc->sz;
-  for(s = *pp; s < ep; s++){
-    if(*s == 0)
-      return s - *pp;
+  for(s = *pp; ; s = ep){
+    if(uvmcheck((uint)s, 1, 0) < 0)
+      return -1;
+    ep = (char*)PGROUNDUP((uint)s + 1);
+    for(; s < ep; s++){
+      if(*s == 0)
+        return s - *pp;
+    }
   }
-  return -1;
 }
 
 // Fetch the nth 32-bit system call argument.
@@ -59,11 +54,25 @@ int
 argptr(int n, char **pp, int size)
 {
   int i;
-  struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || uvmcheck((uint)i, size, 0) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
+// Like argptr, but for memory that the kernel will write
+// into, which must therefore be writable by the user.
+int
+argwptr(int n, char **pp, int size)
+{
+  int i;
+
+  if(argint(n, &i) < 0)
+    return -1;
+  if(size < 0 || uvmcheck((uint)i, size, 1) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -71,8 +80,9 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (A MAP_SHARED region could let another process change the
+// string after this check; the kernel only relies on it being
+// nul-terminated within mapped memory, which stays true.)
 int
 argstr(int n, char **pp)
 {
@@ -94,6 +104,24 @@ extern int sys_kill(void);
 extern int sys_link(void);
 extern int sys_mkdir(void);
 extern int sys_mknod(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_lockbench(void);
+extern int sys_lockstat(void);
+extern int sys_ringenter(void);
+extern int sys_sendfile(void);
+extern int sys_splice(void);
+extern int sys_futex(void);
+extern int sys_clone(void);
+extern int sys_join(void);
+extern int sys_poll(void);
+extern int sys_fcntl(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_shmctl(void);
+extern int sys_clock_gettime(void);
+extern int sys_nanosleep(void);
 extern int sys_open(void);
 extern int sys_pipe(void);
 extern int sys_read(void);
@@ -126,6 +154,24 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_lockbench] sys_lockbench,
+[SYS_lockstat] sys_lockstat,
+[SYS_ringenter] sys_ringenter,
+[SYS_sendfile] sys_sendfile,
+[SYS_splice]  sys_splice,
+[SYS_futex]   sys_futex,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_poll]    sys_poll,
+[SYS_fcntl]   sys_fcntl,
+[SYS_shmget]  sys_shmget,
+[SYS_shmat]   sys_shmat,
+[SYS_shmdt]   sys_shmdt,
+[SYS_shmctl]  sys_shmctl,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_nanosleep] sys_nanosleep,
 };
 
 void
@@ -142,4 +188,6 @@ syscall(void)
             curproc->pid, curproc->name, num);
     curproc->tf->eax = -1;
   }
+  curproc->npin = 0;  // done with user memory; see uvmcheck()
+  fdrelease();        // done with its files; see fdget()
 }
@@ -20,3 +20,21 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_mmap   22
+#define SYS_munmap 23
+#define SYS_lockbench 24
+#define SYS_lockstat 25
+#define SYS_ringenter 26
+#define SYS_sendfile 27
+#define SYS_splice 28
+#define SYS_futex 29
+#define SYS_clone 30
+#define SYS_join  31
+#define SYS_poll  32
+#define SYS_fcntl 33
+#define SYS_shmget 34
+#define SYS_shmat 35
+#define SYS_shmdt 36
+#define SYS_shmctl 37
+#define SYS_clock_gettime 38
+#define SYS_nanosleep 39
@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "ring.h"
+#include "poll.h"
+#include "timer.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -26,7 +29,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f = fdget(fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -41,17 +44,59 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *curproc = myproc();
+  struct fdtable *fdt = myproc()->fdt;
 
+  acquire(&fdt->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(curproc->ofile[fd] == 0){
-      curproc->ofile[fd] = f;
+    if(fdt->ofile[fd] == 0){
+      fdt->ofile[fd] = f;
+      release(&fdt->lock);
       return fd;
     }
   }
+  release(&fdt->lock);
   return -1;
 }
 
+// Undo fdalloc(f) of descriptor fd, handing the file reference
+// back to the caller. Returns 0, or -1 if another thread has
+// closed fd since, and with it that reference.
+static int
+fdunalloc(int fd, struct file *f)
+{
+  struct fdtable *fdt = myproc()->fdt;
+  int r;
+
+  acquire(&fdt->lock);
+  r = -1;
+  if(fdt->ofile[fd] == f){
+    fdt->ofile[fd] = 0;
+    r = 0;
+  }
+  release(&fdt->lock);
+  return r;
+}
+
+// Close descriptor fd of the current process.
+// Returns 0, or -1 if fd is not open.
+static int
+fdclose(int fd)
+{
+  struct fdtable *fdt = myproc()->fdt;
+  struct file *f;
+
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&fdt->lock);
+  f = fdt->ofile[fd];
+  fdt->ofile[fd] = 0;
+  release(&fdt->lock);
+  if(f == 0)
+    return -1;
+  fileclose(f);
+  return 0;
+}
+
 int
 sys_dup(void)
 {
@@ -73,7 +118,7 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0)
     return -1;
   return fileread(f, p, n);
 }
@@ -94,13 +139,37 @@ int
 sys_close(void)
 {
   int fd;
+
+  if(argint(0, &fd) < 0)
+    return -1;
+  return fdclose(fd);
+}
+
+// int fcntl(int fd, int cmd, int arg)
+// The flags belong to the open file, so they are shared
+// with descriptors made by dup() and fork().
+int
+sys_fcntl(void)
+{
   struct file *f;
+  int cmd, arg, mode;
 
-  if(argfd(0, &fd, &f) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
-  fileclose(f);
-  return 0;
+  switch(cmd){
+  case F_GETFL:
+    if(f->readable && f->writable)
+      mode = O_RDWR;
+    else if(f->writable)
+      mode = O_WRONLY;
+    else
+      mode = O_RDONLY;
+    return mode | (f->nonblock ? O_NONBLOCK : 0);
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
 }
 
 int
@@ -109,7 +178,7 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argwptr(1, (void*)&st, sizeof(*st)) < 0)
     return -1;
   return filestat(f, st);
 }
@@ -282,17 +351,15 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-int
-sys_open(void)
+// Open path, which the caller has checked, for sys_open()
+// and ringenter(). Returns the new file descriptor, or -1.
+static int
+openpath(char *path, int omode)
 {
-  char *path;
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
-
   begin_op();
 
   if(omode & O_CREATE){
@@ -307,7 +374,7 @@ sys_open(void)
       return -1;
     }
     ilock(ip);
-    if(ip->type == T_DIR && omode != O_RDONLY){
+    if(ip->type == T_DIR && (omode & (O_WRONLY|O_RDWR))){
       iunlockput(ip);
       end_op();
       return -1;
@@ -329,9 +396,21 @@ sys_open(void)
   f->off = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
   return fd;
 }
 
+int
+sys_open(void)
+{
+  char *path;
+  int omode;
+
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openpath(path, omode);
+}
+
 int
 sys_mkdir(void)
 {
@@ -372,8 +451,8 @@ int
 sys_chdir(void)
 {
   char *path;
-  struct inode *ip;
-  struct proc *curproc = myproc();
+  struct inode *ip, *old;
+  struct fdtable *fdt = myproc()->fdt;
   
   begin_op();
   if(argstr(0, &path) < 0 || (ip = namei(path)) == 0){
@@ -387,36 +466,78 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(curproc->cwd);
+  acquire(&fdt->lock);
+  old = fdt->cwd;
+  fdt->cwd = ip;
+  release(&fdt->lock);
+  iput(old);
   end_op();
-  curproc->cwd = ip;
   return 0;
 }
 
-int
-sys_exec(void)
+// Copy exec()'s path and argument strings into page, so that
+// they outlive the old user memory. The arguments must all fit
+// in a page: exec() puts them on a one-page stack anyway.
+// Returns 0 on success, -1 if an address is bad or there
+// are too many arguments.
+static int
+execargs(char *page, uint upath, uint uargv, char **path, char **argv)
 {
-  char *path, *argv[MAXARG];
-  int i;
-  uint uargv, uarg;
-
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
-  for(i=0;; i++){
-    if(i >= NELEM(argv))
+  uint uarg[MAXARG];
+  int i, n, m, len;
+
+  // Fetch the argument pointers a page's worth at a time:
+  // the array may end just before an unmapped page. A pointer
+  // that straddles a page boundary (argv need not be aligned)
+  // is fetched on its own.
+  for(i = 0; ; i += n){
+    n = (PGSIZE - (uargv + 4*i)%PGSIZE) / 4;
+    if(n == 0)
+      n = 1;
+    if(n > MAXARG - i)
+      n = MAXARG - i;
+    if(n == 0 || copyin(&uarg[i], uargv + 4*i, 4*n) < 0)
       return -1;
-    if(fetchint(uargv+4*i, (int*)&uarg) < 0)
-      return -1;
-    if(uarg == 0){
-      argv[i] = 0;
+    for(m = i; m < i+n && uarg[m]; m++)
+      ;
+    if(m < i+n){
+      n = m - i;
       break;
     }
-    if(fetchstr(uarg, &argv[i]) < 0)
+  }
+  n += i;
+
+  len = 0;
+  *path = page;
+  if((m = copyinstr(page, upath, PGSIZE)) < 0)
+    return -1;
+  len += m + 1;
+  for(i = 0; i < n; i++){
+    argv[i] = page + len;
+    if((m = copyinstr(argv[i], uarg[i], PGSIZE - len)) < 0)
       return -1;
+    len += m + 1;
   }
-  return exec(path, argv);
+  argv[n] = 0;
+  return 0;
+}
+
+int
+sys_exec(void)
+{
+  char *page, *path, *argv[MAXARG];
+  uint upath, uargv;
+  int r;
+
+  if(argint(0, (int*)&upath) < 0 || argint(1, (int*)&uargv) < 0)
+    return -1;
+  if((page = kalloc()) == 0)
+    return -1;
+  r = -1;
+  if(execargs(page, upath, uargv, &path, argv) == 0)
+    r = exec(path, argv);
+  kfree(page);
+  return r;
 }
 
 int
@@ -426,15 +547,14 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argwptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      myproc()->ofile[fd0] = 0;
-    fileclose(rf);
+    if(fd0 < 0 || fdunalloc(fd0, rf) == 0)
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
@@ -442,3 +562,163 @@ sys_pipe(void)
   fd[1] = fd1;
   return 0;
 }
+
+// int sendfile(int outfd, int infd, int n)
+// Copy up to n bytes from the file infd, starting at its
+// offset, to outfd, which may be a pipe, a file or a device.
+int
+sys_sendfile(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(in->type != FD_INODE)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// int splice(int infd, int outfd, int n)
+// Move up to n bytes from infd to outfd, one of which
+// must be a pipe.
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(in->type != FD_PIPE && out->type != FD_PIPE)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+// Carry out one operation from a ring.
+static int
+ringop(struct ringsqe *e)
+{
+  struct file *f;
+  char *path;
+
+  if(e->op == RING_OPEN){
+    if(fetchstr(e->addr, &path) < 0)
+      return -1;
+    return openpath(path, e->n);
+  }
+
+  if(e->op == RING_CLOSE)
+    return fdclose(e->fd);
+  if((f = fdget(e->fd)) == 0)
+    return -1;
+  switch(e->op){
+  case RING_READ:
+    if(e->n < 0 || uvmcheck(e->addr, e->n, 1) < 0)
+      return -1;
+    return fileread(f, (char*)e->addr, e->n);
+  case RING_WRITE:
+    if(e->n < 0 || uvmcheck(e->addr, e->n, 0) < 0)
+      return -1;
+    return filewrite(f, (char*)e->addr, e->n);
+  }
+  return -1;
+}
+
+// int ringenter(struct ring *r)
+// Carry out the operations queued in r's submission ring,
+// in order, posting each result to the completion ring.
+// Stops early if the completion ring fills up.
+// Returns the number of operations carried out.
+int
+sys_ringenter(void)
+{
+  struct proc *curproc = myproc();
+  struct ring *r;
+  struct ringsqe e;
+  struct ringcqe *c;
+  int n, npin;
+
+  if(argwptr(0, (void*)&r, sizeof(*r)) < 0)
+    return -1;
+  // Each operation pins its own buffer; the ring stays pinned.
+  npin = curproc->npin;
+  for(n = 0; r->sqhead != r->sqtail && r->cqtail - r->cqhead < NRING; n++){
+    if(curproc->killed)
+      break;
+    // Work on a copy: the process may rewrite the entry meanwhile.
+    e = r->sq[r->sqhead % NRING];
+    r->sqhead++;
+    c = &r->cq[r->cqtail % NRING];
+    c->data = e.data;
+    c->res = ringop(&e);
+    r->cqtail++;
+    curproc->npin = npin;
+    fdrelease();
+  }
+  return n;
+}
+
+// int poll(struct pollfd *fds, int nfds, int timeout)
+// Wait until one of the nfds files in fds is ready for the
+// events asked for, or for timeout clock ticks: -1 waits for
+// ever, 0 not at all. Entries with a negative fd are skipped.
+// Sets every revents and returns the number of entries with
+// any set, 0 if the time ran out.
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  struct pollwait pw, *wait;
+  struct file *f;
+  struct hrtimer h;
+  int nfds, timeout, i, n;
+  uint64 deadline;
+
+  if(argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE)
+    return -1;
+  if(argwptr(0, (void*)&fds, nfds*sizeof(*fds)) < 0)
+    return -1;
+
+  pw.woken = 0;
+  pw.n = 0;
+  deadline = nsec() + (uint64)timeout * TICKNS;
+  if(timeout > 0){
+    h.when = deadline;
+    h.fn = pollwake;
+    h.arg = &pw;
+    timeradd(&h);
+  }
+  // Only the first scan puts pw on the files' queues.
+  wait = timeout != 0 ? &pw : 0;
+  for(;;){
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if((f = fdget(fds[i].fd)) == 0)
+        fds[i].revents = POLLNVAL;
+      else
+        fds[i].revents = filepoll(f, wait) &
+                         (fds[i].events | POLLERR | POLLHUP);
+      if(fds[i].revents)
+        n++;
+    }
+    wait = 0;
+    if(n > 0 || timeout == 0)
+      break;
+    if(timeout > 0 && nsec() >= deadline)
+      break;
+    if(pollsleep(&pw) < 0){
+      n = -1;
+      break;
+    }
+  }
+  if(timeout > 0)
+    timercancel(&h);
+  pollfree(&pw);
+  return n;
+}
@@ -6,6 +6,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
+#include "clock.h"
+#include "timer.h"
 
 int
 sys_fork(void)
@@ -36,6 +39,27 @@ sys_kill(void)
   return kill(pid);
 }
 
+// int clone(void (*fn)(void*), void *arg, void *stack)
+int
+sys_clone(void)
+{
+  int fn, arg, stack;
+
+  if(argint(0, &fn) < 0 || argint(1, &arg) < 0 || argint(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+int
+sys_join(void)
+{
+  int tid;
+
+  if(argint(0, &tid) < 0)
+    return -1;
+  return join(tid);
+}
+
 int
 sys_getpid(void)
 {
@@ -50,8 +74,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
@@ -60,21 +83,12 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return nanosleep((uint64)n * TICKNS);
 }
 
 // return how many clock tick interrupts have occurred
@@ -89,3 +103,84 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// int clock_gettime(int clock, struct timespec *ts)
+int
+sys_clock_gettime(void)
+{
+  struct timespec *ts;
+  int clock;
+
+  if(argint(0, &clock) < 0 || argwptr(1, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  if(clock != CLOCK_MONOTONIC)
+    return -1;
+  ts->tv_sec = nsecsplit(nsec(), &ts->tv_nsec);
+  return 0;
+}
+
+// int nanosleep(struct timespec *req)
+// Sleep for at least the time in req, to within the
+// resolution of the APIC timer rather than of clock ticks.
+int
+sys_nanosleep(void)
+{
+  struct timespec *req;
+
+  if(argptr(0, (void*)&req, sizeof(*req)) < 0)
+    return -1;
+  if(req->tv_nsec >= 1000000000)
+    return -1;
+  return nanosleep((uint64)req->tv_sec * 1000000000 + req->tv_nsec);
+}
+
+// Lock stress benchmark; see lockbench.c.
+struct {
+  struct spinlock lock;
+  uint hist[NCPU][NLATBUCKET];  // acquire() latencies, log2 cycles
+} lockbench;
+
+void
+lockbenchinit(void)
+{
+  initlock(&lockbench.lock, "lockbench");
+}
+
+// int lockbench(int n, uint *hist)
+// Acquire and release a shared lock n times, recording how
+// long each acquire() took in the current CPU's histogram.
+// If hist is not 0, copy out the histograms of all CPUs and
+// clear them.
+int
+sys_lockbench(void)
+{
+  int n, i, b, h;
+  uint t;
+  char *hist;
+  volatile int j;
+
+  if(argint(0, &n) < 0 || argint(1, &h) < 0)
+    return -1;
+  if(h && argwptr(1, &hist, sizeof(lockbench.hist)) < 0)
+    return -1;
+
+  for(i = 0; i < n && !myproc()->killed; i++){
+    pushcli();  // stay on this CPU
+    t = rdtsc();
+    acquire(&lockbench.lock);
+    t = rdtsc() - t;
+    for(j = 0; j < 100; j++)  // a short critical section
+      ;
+    release(&lockbench.lock);
+    for(b = 0; b < NLATBUCKET-1 && (t >> (b+1)) != 0; b++)
+      ;
+    lockbench.hist[cpuid()][b]++;
+    popcli();
+  }
+
+  if(h){
+    memmove(hist, lockbench.hist, sizeof(lockbench.hist));
+    memset(lockbench.hist, 0, sizeof(lockbench.hist));
+  }
+  return 0;
+}
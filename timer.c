@@ -0,0 +1,352 @@
+// Timekeeping and high-resolution timers.
+//
+// At boot, timerinit() measures the rates of the TSC and of
+// the local APIC timer against the PIT, whose rate is fixed.
+// nsec() then gives the time since boot in nanoseconds from
+// the TSC, which is assumed to run in step on all CPUs.
+//
+// Each CPU runs its local APIC timer in one-shot mode, armed
+// for whichever comes first of its next clock tick (every
+// TICKNS, for preemption and to keep ticks up to date) and the
+// earliest timer in the CPU's heap of pending timers.
+//
+// A CPU with nothing to run stops its clock tick and halts
+// (see scheduler), leaving the timer armed only for its
+// earliest pending timer, if any: an idle machine takes no
+// interrupts it has no use for. Any CPU that takes a tick
+// brings ticks up to date, so ticks keeps counting as long as
+// one CPU is busy, and a CPU waking up from idle catches it up.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "timer.h"
+
+#define PIT_HZ  1193182   // PIT input clock
+#define SHIFT   22        // fixed-point scale for mult and lmult
+
+struct cputimers {
+  struct spinlock lock;
+  struct hrtimer *heap[NPROC];  // min-heap ordered by when
+  int n;
+  uint64 nexttick;
+  int idle;                     // clock tick stopped
+};
+
+static struct cputimers timers[NCPU];
+static uint64 tsc0;   // TSC at boot
+static uint mult;     // ns = TSC cycles * mult >> SHIFT
+static uint lmult;    // APIC timer counts = ns * lmult >> SHIFT
+static uint tsctick;  // TSC cycles per clock tick
+static uint64 tickns; // nsec() time of the next tick; under tickslock
+
+// n / d, with the remainder in *rem if rem is set.
+// The kernel has no libgcc to do 64-bit division for it.
+static uint64
+div64(uint64 n, uint d, uint *rem)
+{
+  uint64 q, r;
+  int i;
+
+  q = r = 0;
+  for(i = 63; i >= 0; i--){
+    r = (r << 1) | ((n >> i) & 1);
+    if(r >= d){
+      r -= d;
+      q |= (uint64)1 << i;
+    }
+  }
+  if(rem)
+    *rem = r;
+  return q;
+}
+
+// Nanoseconds since boot.
+uint64
+nsec(void)
+{
+  uint64 c;
+
+  c = rdtsc() - tsc0;
+  return ((c >> 32) * mult << (32 - SHIFT)) +
+         (((c & 0xFFFFFFFF) * mult) >> SHIFT);
+}
+
+// Split ns into seconds and nanoseconds.
+uint
+nsecsplit(uint64 ns, uint *nsrem)
+{
+  return div64(ns, 1000000000, nsrem);
+}
+
+void
+timerinit(void)
+{
+  uint64 t0, t1;
+  uint l0, l1, tsckhz, lapickhz;
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&timers[i].lock, "timers");
+
+  // Have PIT channel 2 count down 50 ms, with the speaker
+  // off, and see how far the TSC and the APIC timer get.
+  outb(0x61, (inb(0x61) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(0x43, 0xB0);                        // channel 2, mode 0
+  outb(0x42, (PIT_HZ/20) & 0xFF);
+  outb(0x42, (PIT_HZ/20) >> 8);
+  lapictimer(0xFFFFFFFF);
+  t0 = rdtsc();
+  l0 = lapictimercount();
+  while((inb(0x61) & 0x20) == 0)           // wait for OUT2
+    ;
+  t1 = rdtsc();
+  l1 = lapictimercount();
+
+  tsckhz = (uint)(t1 - t0) / 50;
+  lapickhz = (l0 - l1) / 50;
+  if(tsckhz == 0 || lapickhz == 0)
+    panic("timerinit");
+  tsc0 = t0;
+  mult = div64((uint64)1000000 << SHIFT, tsckhz, 0);
+  tsctick = tsckhz * (TICKNS / 1000000);
+  lmult = div64((uint64)lapickhz << SHIFT, 1000000, 0);
+  cprintf("timer: tsc %d kHz, lapic timer %d kHz\n", tsckhz, lapickhz);
+}
+
+//PAGEBREAK!
+static void
+heapswap(struct cputimers *t, int a, int b)
+{
+  struct hrtimer *h;
+
+  h = t->heap[a];
+  t->heap[a] = t->heap[b];
+  t->heap[b] = h;
+  t->heap[a]->i = a;
+  t->heap[b]->i = b;
+}
+
+static void
+heapup(struct cputimers *t, int i)
+{
+  while(i > 0 && t->heap[(i-1)/2]->when > t->heap[i]->when){
+    heapswap(t, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+heapdown(struct cputimers *t, int i)
+{
+  int c;
+
+  for(;;){
+    c = 2*i + 1;
+    if(c >= t->n)
+      break;
+    if(c+1 < t->n && t->heap[c+1]->when < t->heap[c]->when)
+      c++;
+    if(t->heap[i]->when <= t->heap[c]->when)
+      break;
+    heapswap(t, i, c);
+    i = c;
+  }
+}
+
+static void
+heapinsert(struct cputimers *t, struct hrtimer *h)
+{
+  if(t->n == NPROC)
+    panic("heapinsert");
+  h->i = t->n;
+  t->heap[t->n++] = h;
+  heapup(t, h->i);
+}
+
+static void
+heapremove(struct cputimers *t, int i)
+{
+  t->heap[i]->i = -1;
+  if(i != --t->n){
+    t->heap[i] = t->heap[t->n];
+    t->heap[i]->i = i;
+    heapdown(t, i);
+    heapup(t, i);
+  }
+}
+
+// Arm this CPU's APIC timer for its next event, or stop it
+// if it is idle and has no timers.
+// Must hold t->lock, where t is this CPU's timers.
+static void
+timerset(struct cputimers *t)
+{
+  uint64 when, now, ns;
+  uint count;
+
+  if(t->idle){
+    if(t->n == 0){
+      lapictimer(0);
+      return;
+    }
+    when = t->heap[0]->when;
+  } else {
+    when = t->nexttick;
+    if(t->n > 0 && t->heap[0]->when < when)
+      when = t->heap[0]->when;
+  }
+  now = nsec();
+  ns = when > now ? when - now : 0;
+  if(ns > 1000000000)  // idle: wake at least once a second
+    ns = 1000000000;
+  if((count = (ns * lmult) >> SHIFT) == 0)
+    count = 1;
+  lapictimer(count);
+}
+
+// Bring ticks, and the vdso, up to date with nsec() time now.
+static void
+tickupdate(uint64 now)
+{
+  acquire(&tickslock);
+  if(now >= tickns){
+    ticks = div64(now, TICKNS, 0);
+    tickns = (uint64)(ticks + 1) * TICKNS;
+    vdsotick(ticks, tsc0 + (uint64)ticks * tsctick, tsctick);
+  }
+  release(&tickslock);
+}
+
+// Switch this CPU's APIC timer to one-shot mode.
+// Called once by each CPU, with interrupts off.
+void
+timerstart(void)
+{
+  struct cputimers *t = &timers[cpuid()];
+
+  acquire(&t->lock);
+  t->idle = 0;
+  t->nexttick = nsec() + TICKNS;
+  timerset(t);
+  release(&t->lock);
+}
+
+// Handle a timer interrupt: run the timers whose time has
+// come and arm the timer again.
+void
+timerintr(void)
+{
+  struct cputimers *t = &timers[cpuid()];
+  struct hrtimer *h;
+  uint64 now;
+  int tick;
+
+  acquire(&t->lock);
+  now = nsec();
+  while(t->n > 0 && t->heap[0]->when <= now){
+    h = t->heap[0];
+    heapremove(t, 0);
+    h->fn(h->arg);
+  }
+  tick = 0;
+  if(!t->idle && now >= t->nexttick){
+    tick = 1;
+    t->nexttick += TICKNS;
+    if(t->nexttick <= now)  // fell behind: do not catch up
+      t->nexttick = now + TICKNS;
+  }
+  timerset(t);
+  release(&t->lock);
+  if(tick)
+    tickupdate(now);
+}
+
+// This CPU has nothing to run and is about to halt:
+// stop its clock tick. Called with interrupts off.
+void
+timeridle(void)
+{
+  struct cputimers *t = &timers[cpuid()];
+
+  acquire(&t->lock);
+  t->idle = 1;
+  timerset(t);
+  release(&t->lock);
+}
+
+// This CPU is back from halting: restart its clock tick.
+// Called with interrupts off.
+void
+timerwake(void)
+{
+  struct cputimers *t = &timers[cpuid()];
+  uint64 now;
+
+  acquire(&t->lock);
+  now = nsec();
+  t->idle = 0;
+  t->nexttick = now + TICKNS;
+  timerset(t);
+  release(&t->lock);
+  tickupdate(now);
+}
+
+// Arrange for h->fn(h->arg) to be called at h->when, on this
+// CPU's timer interrupt, unless timercancel() comes first.
+void
+timeradd(struct hrtimer *h)
+{
+  struct cputimers *t;
+
+  pushcli();
+  t = &timers[cpuid()];
+  acquire(&t->lock);
+  popcli();
+  h->t = t;
+  heapinsert(t, h);
+  if(t->heap[0] == h)
+    timerset(t);  // still on t's CPU: we hold t->lock
+  release(&t->lock);
+}
+
+// Take h off its heap if it has not fired yet.
+void
+timercancel(struct hrtimer *h)
+{
+  acquire(&h->t->lock);
+  if(h->i >= 0)
+    heapremove(h->t, h->i);
+  release(&h->t->lock);
+}
+
+// Sleep for ns nanoseconds.
+// Returns 0, or -1 if the process was killed first.
+int
+nanosleep(uint64 ns)
+{
+  struct cputimers *t;
+  struct hrtimer h;
+
+  h.when = nsec() + ns;
+  h.fn = wakeup;
+  h.arg = &h;
+  timeradd(&h);
+  t = h.t;
+  acquire(&t->lock);
+  while(h.i >= 0){
+    if(myproc()->killed){
+      heapremove(t, h.i);
+      release(&t->lock);
+      return -1;
+    }
+    sleep(&h, &t->lock);
+  }
+  release(&t->lock);
+  return 0;
+}
@@ -0,0 +1,12 @@
+#define TICKNS  10000000  // nanoseconds per clock tick: 100 Hz
+
+// A one-shot timer: fn(arg) is called from the timer interrupt
+// of the CPU that added it, holding a spinlock, soon after when
+// (in nsec() time). See timeradd in timer.c.
+struct hrtimer {
+  uint64 when;
+  void (*fn)(void*);
+  void *arg;
+  struct cputimers *t;  // heap it was added to
+  int i;                // index in the heap; -1 if not pending
+};
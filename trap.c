@@ -7,10 +7,15 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
+extern void sysentry(); // in trapasm.S
+extern void sysentryflags();
 struct spinlock tickslock;
 uint ticks;
 
@@ -30,12 +35,33 @@ void
 idtinit(void)
 {
   lidt(idt, sizeof(idt));
+  // sysenter enters the kernel at sysentry. It loads %cs from
+  // this MSR and %ss from the following GDT entry; sysexit the
+  // user ones from the two after that. switchuvm() points
+  // MSR_SYSENTER_ESP at each process's kernel stack.
+  wrmsr(MSR_SYSENTER_CS, SEG_KCODE<<3);
+  wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+}
+
+// System calls made with sysenter come here from sysentry,
+// bypassing trap(). tf is laid out as for int $T_SYSCALL.
+void
+fastsyscall(struct trapframe *tf)
+{
+  if(myproc()->killed)
+    exit();
+  myproc()->tf = tf;
+  syscall();
+  if(myproc()->killed)
+    exit();
 }
 
 //PAGEBREAK: 41
 void
 trap(struct trapframe *tf)
 {
+  uint va;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -46,14 +72,17 @@ trap(struct trapframe *tf)
     return;
   }
 
+  // A user TF survives sysenter and single-steps the first
+  // instructions of sysentry, until it loads clean flags.
+  if(tf->trapno == T_DEBUG && (tf->cs&3) == 0 &&
+     tf->eip > (uint)sysentry && tf->eip <= (uint)sysentryflags){
+    tf->eflags &= ~FL_TF;
+    return;
+  }
+
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    timerintr();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -71,6 +100,14 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_CALL:
+    ipiintr();
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Only there to end a hlt in scheduler().
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -78,6 +115,20 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // Handle user faults with interrupts on, as system calls
+    // are: pagefault() may wait for a sibling thread's vm->lock,
+    // and that thread may be waiting for this CPU to take a
+    // TLB shootdown IPI (see ipi.c).
+    if(myproc() != 0 && (tf->cs&3) == DPL_USER){
+      va = rcr2();
+      sti();
+      if(pagefault(va, tf->err) == 0)
+        break;
+      cli();
+    }
+    // fall through: not a page the process may touch
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_RESCHED     20      // IPI: wake an idle CPU
+#define IRQ_CALL        21      // IPI: run queued calls (ipi.c)
 #define IRQ_SPURIOUS    31
 
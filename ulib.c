@@ -3,6 +3,10 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "vdso.h"
+#include "futex.h"
+#include "mman.h"
+#include "param.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -104,3 +108,192 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// getpid() and uptime() read the pages the kernel maps
+// at VDSO (see vdso.c), without a system call.
+// The pid page belongs to the address space, so once threads
+// share it, it holds 0 and getpid() asks the kernel instead.
+int
+getpid(void)
+{
+  int pid;
+
+  if((pid = ((volatile struct vdsoproc*)VDSOPROC)->pid) == 0)
+    pid = sysgetpid();
+  return pid;
+}
+
+int
+uptime(void)
+{
+  return ((volatile struct vdso*)VDSO)->ticks;
+}
+
+// Time since boot in 1024ths of a clock tick,
+// interpolating between ticks with the TSC.
+uint
+uptimefine(void)
+{
+  volatile struct vdso *v = (volatile struct vdso*)VDSO;
+  uint seq, t, d, per;
+  uint64 tsc;
+
+  do {
+    seq = v->seq;
+    t = v->ticks;
+    tsc = v->tsc;
+    per = v->tsctick;
+  } while((seq & 1) || seq != v->seq);
+
+  if(per < 1024)
+    return t*1024;  // not measured yet
+  d = (uint)(rdtsc() - tsc) / (per/1024);
+  if(d > 1023)
+    d = 1023;
+  return t*1024 + d;
+}
+
+// Mutexes, after Drepper's "Futexes Are Tricky": taking a free
+// mutex or releasing one nobody waits for is a single atomic
+// instruction, with no system call.
+void
+mutex_lock(struct mutex *m)
+{
+  uint c;
+
+  if((c = cmpxchg(&m->val, 0, 1)) == 0)
+    return;
+  // Contended: mark the mutex as waited for, then sleep
+  // until it is free.
+  if(c != 2)
+    c = xchg(&m->val, 2);
+  while(c != 0){
+    futex(&m->val, FUTEX_WAIT, 2);
+    c = xchg(&m->val, 2);
+  }
+}
+
+int
+mutex_trylock(struct mutex *m)
+{
+  return cmpxchg(&m->val, 0, 1) == 0;
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(xadd(&m->val, -1) != 1){
+    m->val = 0;
+    futex(&m->val, FUTEX_WAKE, 1);
+  }
+}
+
+// Wait on c, which m protects. m is held on return.
+// Returns after any signal, which the caller cannot tell
+// apart from a spurious wakeup: check the condition again.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  uint seq;
+
+  seq = c->seq;
+  mutex_unlock(m);
+  futex(&c->seq, FUTEX_WAIT, seq);
+  // Others may be woken along with us: take m as
+  // waited for, so that unlocking it wakes the next.
+  while(xchg(&m->val, 2) != 0)
+    futex(&m->val, FUTEX_WAIT, 2);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  xadd(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  xadd(&c->seq, 1);
+  futex(&c->seq, FUTEX_WAKE, NPROC);
+}
+
+// Threads, on clone() and join(). Each thread gets its own
+// mmap()ed stack, which thread_join() gives back.
+#define TSTACKSIZE (4*4096)
+
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static struct {
+  struct mutex lock;
+  int tid[NPROC];
+  char *stack[NPROC];
+} threads;
+
+// The first function of every thread: run fn(arg) and exit.
+// The clone() call left t at the top of the thread's stack.
+static void
+threadstart(void *a)
+{
+  struct tstart *t = a;
+
+  t->fn(t->arg);
+  exit();
+}
+
+// Start a thread running fn(arg) in this process.
+// Returns its thread id, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct tstart *t;
+  char *stack;
+  int i, tid;
+
+  stack = mmap(0, TSTACKSIZE, PROT_READ|PROT_WRITE,
+               MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(stack == MAP_FAILED)
+    return -1;
+  t = (struct tstart*)(stack + TSTACKSIZE) - 1;
+  t->fn = fn;
+  t->arg = arg;
+
+  mutex_lock(&threads.lock);
+  for(i = 0; i < NPROC; i++)
+    if(threads.stack[i] == 0)
+      break;
+  if(i == NPROC || (tid = clone(threadstart, t, t)) < 0){
+    mutex_unlock(&threads.lock);
+    munmap(stack, TSTACKSIZE);
+    return -1;
+  }
+  threads.tid[i] = tid;
+  threads.stack[i] = stack;
+  mutex_unlock(&threads.lock);
+  return tid;
+}
+
+// Wait for thread tid to finish and free its stack.
+// Returns 0, or -1 if there is no such thread.
+int
+thread_join(int tid)
+{
+  int i;
+
+  if(join(tid) < 0)
+    return -1;
+  mutex_lock(&threads.lock);
+  for(i = 0; i < NPROC; i++){
+    if(threads.stack[i] && threads.tid[i] == tid){
+      munmap(threads.stack[i], TSTACKSIZE);
+      threads.stack[i] = 0;
+      break;
+    }
+  }
+  mutex_unlock(&threads.lock);
+  return 0;
+}
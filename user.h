@@ -1,4 +1,8 @@
 struct stat;
+struct lockstat;
+struct ring;
+struct pollfd;
+struct timespec;
 struct rtcdate;
 
 // system calls
@@ -19,10 +23,28 @@ int link(const char*, const char*);
 int mkdir(const char*);
 int chdir(const char*);
 int dup(int);
-int getpid(void);
+int sysgetpid(void);
 char* sbrk(int);
 int sleep(int);
-int uptime(void);
+int sysuptime(void);
+void* mmap(void*, uint, int, int, int, int);
+int munmap(void*, uint);
+int lockbench(int, uint*);
+int lockstat(struct lockstat*, int);
+int ringenter(struct ring*);
+int sendfile(int, int, int);
+int splice(int, int, int);
+int futex(volatile void*, int, int);
+int clone(void (*)(void*), void*, void*);
+int join(int);
+int poll(struct pollfd*, int, int);
+int fcntl(int, int, int);
+int shmget(int, uint, int);
+void* shmat(int);
+int shmdt(void*);
+int shmctl(int, int);
+int clock_gettime(int, struct timespec*);
+int nanosleep(struct timespec*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -37,3 +59,24 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int getpid(void);
+int uptime(void);
+uint uptimefine(void);
+
+// Locks for threads or processes sharing memory, which only
+// enter the kernel to wait (see ulib.c). Zero-filled memory
+// holds an unlocked mutex and a condition nobody waits on.
+struct mutex {
+  uint val;  // 0 unlocked, 1 locked, 2 locked and maybe waited for
+};
+struct cond {
+  uint seq;  // bumped by every signal
+};
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+int thread_create(void (*)(void*), void*);
+int thread_join(int);
@@ -7,6 +7,13 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "mman.h"
+#include "vdso.h"
+#include "ring.h"
+#include "futex.h"
+#include "poll.h"
+#include "shm.h"
+#include "clock.h"
 
 char buf[8192];
 char name[3];
@@ -300,6 +307,33 @@ exectest(void)
   }
 }
 
+// exec with an argv array that is not word-aligned and has a
+// pointer straddling a page boundary.
+void
+execunaligned(void)
+{
+  char *p, **argv;
+  int pid;
+
+  printf(stdout, "exec unaligned argv test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    p = sbrk(2*4096);
+    p = (char*)(((uint)p + 4096) & ~4095);  // next page boundary
+    argv = (char**)(p - 2);
+    memmove(argv, (char*[]){ "echo", "exec", "unaligned", "ok", 0 },
+            5*sizeof(char*));
+    exec("echo", argv);
+    printf(stdout, "exec unaligned argv failed\n");
+    exit();
+  }
+  wait();
+}
+
 // simple fork and pipe read/write
 
 void
@@ -1737,6 +1771,994 @@ void argptest()
   printf(1, "arg test passed\n");
 }
 
+// mmap(): anonymous, shared and file-backed regions, and munmap().
+void
+mmaptest(void)
+{
+  char *a, *b, *f;
+  int fd, i, pid;
+
+  printf(stdout, "mmap test\n");
+
+  a = mmap(0, 3*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  b = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED || b == MAP_FAILED || (uint)a < MMAPBASE){
+    printf(stdout, "mmap anonymous failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*4096; i++){
+    if(a[i] != 0){
+      printf(stdout, "mmap page not zeroed\n");
+      exit();
+    }
+    a[i] = i;
+  }
+  b[0] = 'p';
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(a[4097] != (char)4097 || b[0] != 'p'){
+      printf(stdout, "mmap not inherited\n");
+      exit();
+    }
+    a[4097] = 'c';
+    b[0] = 'c';
+    exit();
+  }
+  wait();
+  if(a[4097] != (char)4097 || b[0] != 'c'){
+    printf(stdout, "mmap sharing wrong %x %x\n", a[4097], b[0]);
+    exit();
+  }
+
+  // munmap the middle page; the other two must survive.
+  if(munmap(a + 4096, 4096) < 0 || munmap(b, 4096) < 0){
+    printf(stdout, "munmap failed\n");
+    exit();
+  }
+  if(a[0] != 0 || a[8192] != (char)8192){
+    printf(stdout, "munmap removed too much\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    a[4096] = 1;
+    printf(stdout, "munmap did not unmap\n");
+    exit();
+  }
+  wait();
+  munmap(a, 3*4096);
+
+  // A read-only view of a file.
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = 'a' + i % 26;
+  if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "mmap file write failed\n");
+    exit();
+  }
+  f = mmap(0, sizeof(buf), PROT_READ, MAP_SHARED, fd, 0);
+  if(f == MAP_FAILED){
+    printf(stdout, "mmap file failed\n");
+    exit();
+  }
+  if(mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0) != MAP_FAILED){
+    printf(stdout, "mmap writable shared file succeeded\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(buf); i++){
+    if(f[i] != 'a' + i % 26){
+      printf(stdout, "mmap file contents wrong at %d\n", i);
+      exit();
+    }
+  }
+  // The kernel must not write into a read-only mapping either.
+  if(read(fd, f, 10) >= 0){
+    printf(stdout, "read into read-only mapping succeeded\n");
+    exit();
+  }
+  munmap(f, sizeof(buf));
+  close(fd);
+  unlink("mmapfile");
+
+  printf(stdout, "mmap test ok\n");
+}
+
+// Reads go through the page cache; writes must keep
+// cached pages up to date, including across a page boundary.
+void
+pagecachetest(void)
+{
+  int fd, i;
+
+  printf(stdout, "page cache test\n");
+  memset(buf, 'a', sizeof(buf));
+  fd = open("pcfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "page cache write failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("pcfile", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "page cache read failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("pcfile", O_RDWR);
+  memset(buf, 'b', 200);
+  if(write(fd, buf + 200, 4000) != 4000 || write(fd, buf, 200) != 200){
+    printf(stdout, "page cache overwrite failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("pcfile", O_RDONLY);
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "page cache reread failed\n");
+    exit();
+  }
+  close(fd);
+  for(i = 0; i < sizeof(buf); i++){
+    if(buf[i] != (i >= 4000 && i < 4200 ? 'b' : 'a')){
+      printf(stdout, "page cache stale at %d\n", i);
+      exit();
+    }
+  }
+  unlink("pcfile");
+  printf(stdout, "page cache test ok\n");
+}
+
+// Several processes read the same file and walk the same
+// directories at once, sharing the inode locks.
+void
+sharedreadtest(void)
+{
+  struct stat st;
+  int fd, i, j, k, pid;
+
+  printf(stdout, "shared read test\n");
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i % 251;
+  fd = open("srfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, sizeof(buf)) != sizeof(buf)){
+    printf(stdout, "shared read: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(j = 0; j < 10; j++){
+        if(stat("/srfile", &st) < 0 || st.size != sizeof(buf)){
+          printf(stdout, "shared read: stat failed\n");
+          exit();
+        }
+        fd = open("/srfile", O_RDONLY);
+        memset(buf, 0, sizeof(buf));
+        if(fd < 0 || read(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf(stdout, "shared read: read failed\n");
+          exit();
+        }
+        close(fd);
+        for(k = 0; k < sizeof(buf); k++){
+          if(buf[k] != (char)(k % 251)){
+            printf(stdout, "shared read: wrong data\n");
+            exit();
+          }
+        }
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++)
+    wait();
+  unlink("srfile");
+  printf(stdout, "shared read test ok\n");
+}
+
+// Program text is mapped read-only (and shared with every
+// other process running usertests).
+void
+texttest(void)
+{
+  int fd, pid;
+
+  printf(stdout, "text test\n");
+  fd = open("echo", O_RDONLY);
+  if(fd < 0 || read(fd, (char*)texttest, 10) >= 0){
+    printf(stdout, "read into text succeeded\n");
+    exit();
+  }
+  close(fd);
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    *(char*)texttest = 0;
+    printf(stdout, "write to text succeeded\n");
+    exit();
+  }
+  wait();
+  printf(stdout, "text test ok\n");
+}
+
+// getpid() and uptime() read the vdso pages, which
+// user code must not be able to write.
+void
+vdsotest(void)
+{
+  int pid, t;
+  uint f0, f1;
+
+  printf(stdout, "vdso test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(getpid() != sysgetpid()){
+      printf(stdout, "vdso: wrong pid %d, not %d\n", getpid(), sysgetpid());
+      exit();
+    }
+    t = sysuptime();
+    if(uptime() < t - 1 || uptime() > t + 1){
+      printf(stdout, "vdso: wrong uptime\n");
+      exit();
+    }
+    f0 = uptimefine();
+    sleep(2);
+    f1 = uptimefine();
+    if(f1 < f0 + 1024){
+      printf(stdout, "vdso: uptimefine did not advance\n");
+      exit();
+    }
+    *(int*)VDSOPROC = 0;
+    printf(stdout, "write to vdso succeeded\n");
+    exit();
+  }
+  wait();
+  printf(stdout, "vdso test ok\n");
+}
+
+// Open, write and close a file with one ringenter().
+void
+ringtest(void)
+{
+  static struct ring r;
+  struct ringsqe *e;
+  int fd, i;
+
+  printf(stdout, "ring test\n");
+  memset(&r, 0, sizeof(r));
+  for(i = 0; i < 5; i++){
+    e = &r.sq[r.sqtail++ % NRING];
+    e->data = i;
+  }
+  // The open's fd is not known yet: the file is the lowest
+  // free descriptor, which a dup() beforehand finds.
+  fd = dup(0);
+  close(fd);
+  r.sq[0].op = RING_OPEN;
+  r.sq[0].addr = (uint)"ringfile";
+  r.sq[0].n = O_CREATE|O_RDWR;
+  r.sq[1].op = RING_WRITE;
+  r.sq[1].fd = fd;
+  r.sq[1].addr = (uint)"0123456789";
+  r.sq[1].n = 10;
+  r.sq[2].op = RING_CLOSE;
+  r.sq[2].fd = fd;
+  r.sq[3].op = RING_CLOSE;
+  r.sq[3].fd = fd;
+  r.sq[4].op = RING_READ;
+  r.sq[4].fd = -1;
+  if(ringenter(&r) != 5 || r.cqtail != 5){
+    printf(stdout, "ringenter failed\n");
+    exit();
+  }
+  if(r.cq[0].res != fd || r.cq[1].res != 10 || r.cq[2].res != 0 ||
+     r.cq[3].res != -1 || r.cq[4].res != -1 || r.cq[4].data != 4){
+    printf(stdout, "ring: wrong results\n");
+    exit();
+  }
+  fd = open("ringfile", O_RDONLY);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 10 || buf[9] != '9'){
+    printf(stdout, "ring: file not written\n");
+    exit();
+  }
+  close(fd);
+  unlink("ringfile");
+  printf(stdout, "ring test ok\n");
+}
+
+// sendfile() a file into a pipe, then splice() the
+// pipe into another file.
+void
+splicetest(void)
+{
+  int fd, fds[2], i, n;
+
+  printf(stdout, "splice test\n");
+  for(i = 0; i < 6000; i++)
+    buf[i] = i % 199;
+  fd = open("splicein", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, 6000) != 6000){
+    printf(stdout, "splice: write failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("splicein", O_RDONLY);
+  if(fd < 0 || pipe(fds) != 0){
+    printf(stdout, "splice: open failed\n");
+    exit();
+  }
+  if((n = sendfile(fds[1], fd, 10000)) != 6000){
+    printf(stdout, "sendfile returned %d\n", n);
+    exit();
+  }
+  if(sendfile(fds[1], fd, 10) != 0 || sendfile(fd, fds[0], 10) != -1){
+    printf(stdout, "sendfile: bad end of file or input\n");
+    exit();
+  }
+  close(fd);
+  close(fds[1]);
+
+  fd = open("spliceout", O_CREATE|O_RDWR);
+  for(i = 0; i < 6000; i += n){
+    if((n = splice(fds[0], fd, 6000 - i)) <= 0){
+      printf(stdout, "splice returned %d\n", n);
+      exit();
+    }
+  }
+  if(splice(fds[0], fd, 10) != 0){
+    printf(stdout, "splice: no end of file\n");
+    exit();
+  }
+  close(fd);
+  close(fds[0]);
+
+  fd = open("spliceout", O_RDONLY);
+  memset(buf, 0, 6000);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 6000){
+    printf(stdout, "splice: short file\n");
+    exit();
+  }
+  for(i = 0; i < 6000; i++){
+    if(buf[i] != (char)(i % 199)){
+      printf(stdout, "splice: wrong data\n");
+      exit();
+    }
+  }
+  close(fd);
+  unlink("splicein");
+  unlink("spliceout");
+  printf(stdout, "splice test ok\n");
+}
+
+// Processes sharing a page count under a futex mutex,
+// and the last one to finish signals the parent.
+void
+futextest(void)
+{
+  struct shared {
+    struct mutex m;
+    struct cond done;
+    int count;
+    int ndone;
+  } *s;
+  int i, j, pid;
+
+  printf(stdout, "futex test\n");
+  s = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  if(s == MAP_FAILED){
+    printf(stdout, "futex: mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < 4; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(j = 0; j < 1000; j++){
+        mutex_lock(&s->m);
+        s->count++;
+        mutex_unlock(&s->m);
+      }
+      mutex_lock(&s->m);
+      if(++s->ndone == 4)
+        cond_signal(&s->done);
+      mutex_unlock(&s->m);
+      exit();
+    }
+  }
+  mutex_lock(&s->m);
+  while(s->ndone < 4)
+    cond_wait(&s->done, &s->m);
+  mutex_unlock(&s->m);
+  if(s->count != 4000){
+    printf(stdout, "futex: count %d, not 4000\n", s->count);
+    exit();
+  }
+  if(futex(&s->count, FUTEX_WAIT, 0) != -1){
+    printf(stdout, "futex: waited on a changed word\n");
+    exit();
+  }
+  for(i = 0; i < 4; i++)
+    wait();
+  munmap(s, 4096);
+  printf(stdout, "futex test ok\n");
+}
+
+// Threads share memory: a plain global is enough.
+struct mutex threadlock;
+int threadcount;
+
+void
+threadadd(void *arg)
+{
+  int i;
+
+  for(i = 0; i < (int)arg; i++){
+    mutex_lock(&threadlock);
+    threadcount++;
+    mutex_unlock(&threadlock);
+  }
+}
+
+void
+threadtest(void)
+{
+  int i, tid[4];
+
+  printf(stdout, "thread test\n");
+  for(i = 0; i < 4; i++){
+    if((tid[i] = thread_create(threadadd, (void*)1000)) < 0){
+      printf(stdout, "thread_create failed\n");
+      exit();
+    }
+  }
+  // Threads are not children for wait().
+  if(wait() != -1){
+    printf(stdout, "thread: wait found a thread\n");
+    exit();
+  }
+  for(i = 0; i < 4; i++){
+    if(thread_join(tid[i]) < 0){
+      printf(stdout, "thread_join failed\n");
+      exit();
+    }
+  }
+  if(threadcount != 4000){
+    printf(stdout, "thread: count %d, not 4000\n", threadcount);
+    exit();
+  }
+  if(join(tid[0]) != -1){
+    printf(stdout, "thread: joined a thread twice\n");
+    exit();
+  }
+  printf(stdout, "thread test ok\n");
+}
+
+int threadfds[2];
+int threadpid;
+
+void
+threadpipe(void *arg)
+{
+  threadpid = getpid();
+  if(pipe(threadfds) < 0)
+    threadfds[0] = -1;
+}
+
+// Threads share their open files: a pipe one thread opens
+// is there for the others.
+void
+threadfdtest(void)
+{
+  int tid;
+  char c;
+
+  printf(stdout, "thread fd test\n");
+  if((tid = thread_create(threadpipe, 0)) < 0 || thread_join(tid) < 0){
+    printf(stdout, "thread_create failed\n");
+    exit();
+  }
+  if(threadpid != tid){
+    printf(stdout, "thread: getpid %d, not %d\n", threadpid, tid);
+    exit();
+  }
+  if(threadfds[0] < 0 || write(threadfds[1], "x", 1) != 1 ||
+     read(threadfds[0], &c, 1) != 1 || c != 'x'){
+    printf(stdout, "thread fd: pipe not shared\n");
+    exit();
+  }
+  close(threadfds[0]);
+  close(threadfds[1]);
+  printf(stdout, "thread fd test ok\n");
+}
+
+volatile int shootstop;
+
+void
+shootspin(void *arg)
+{
+  while(!shootstop)
+    ;
+}
+
+// Unmap memory over and over while a sibling thread runs on
+// another CPU with the address space loaded: the pages freed
+// must have been shot down from its TLB before they are reused.
+void
+shootdowntest(void)
+{
+  char *a;
+  int tid, i, j;
+
+  printf(stdout, "shootdown test\n");
+  shootstop = 0;
+  if((tid = thread_create(shootspin, 0)) < 0){
+    printf(stdout, "thread_create failed\n");
+    exit();
+  }
+  for(i = 0; i < 50; i++){
+    a = mmap(0, 16*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(a == MAP_FAILED){
+      printf(stdout, "shootdown: mmap failed\n");
+      exit();
+    }
+    for(j = 0; j < 16; j++){
+      if(a[j*4096] != 0){
+        printf(stdout, "shootdown: new page not zero\n");
+        exit();
+      }
+      a[j*4096] = 1;
+    }
+    if(munmap(a, 16*4096) < 0){
+      printf(stdout, "shootdown: munmap failed\n");
+      exit();
+    }
+    if((a = sbrk(4096)) == (char*)-1){
+      printf(stdout, "shootdown: sbrk failed\n");
+      exit();
+    }
+    a[0] = 1;
+    sbrk(-4096);
+  }
+  shootstop = 1;
+  if(thread_join(tid) < 0){
+    printf(stdout, "thread_join failed\n");
+    exit();
+  }
+  printf(stdout, "shootdown test ok\n");
+}
+
+// Map, fault in and unmap pages n times.
+void
+faultloop(void *arg)
+{
+  char *a;
+  int i, j;
+
+  for(i = 0; i < (int)arg; i++){
+    a = mmap(0, 16*4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(a == MAP_FAILED){
+      printf(stdout, "faultunmap: mmap failed\n");
+      exit();
+    }
+    for(j = 0; j < 16; j++)
+      a[j*4096] = 1;
+    if(munmap(a, 16*4096) < 0){
+      printf(stdout, "faultunmap: munmap failed\n");
+      exit();
+    }
+  }
+}
+
+// Two threads fault in fresh pages while the other unmaps:
+// a fault waiting for vm->lock must still take the unmapping
+// thread's TLB shootdown IPI.
+void
+faultunmaptest(void)
+{
+  int tid;
+
+  printf(stdout, "fault unmap test\n");
+  if((tid = thread_create(faultloop, (void*)200)) < 0){
+    printf(stdout, "thread_create failed\n");
+    exit();
+  }
+  faultloop((void*)200);
+  if(thread_join(tid) < 0){
+    printf(stdout, "thread_join failed\n");
+    exit();
+  }
+  printf(stdout, "fault unmap test ok\n");
+}
+
+static int unmappipe[2];
+
+void
+unmapreader(void *arg)
+{
+  if(read(unmappipe[0], arg, 4096) != 1)
+    printf(stdout, "pinned unmap: read failed\n");
+}
+
+// A buffer that a sibling thread is blocked reading into can
+// be neither unmapped nor given back with sbrk() until the
+// read finishes.
+void
+pinnedunmaptest(void)
+{
+  char *a, *b;
+  int tid;
+
+  printf(stdout, "pinned unmap test\n");
+  if(pipe(unmappipe) < 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  a = mmap(0, 4096, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(a == MAP_FAILED){
+    printf(stdout, "pinned unmap: mmap failed\n");
+    exit();
+  }
+  if((tid = thread_create(unmapreader, a)) < 0){
+    printf(stdout, "thread_create failed\n");
+    exit();
+  }
+  sleep(2);  // let the reader block
+  if(munmap(a, 4096) == 0){
+    printf(stdout, "pinned unmap: munmap of a pinned buffer succeeded\n");
+    exit();
+  }
+  write(unmappipe[1], "x", 1);
+  if(thread_join(tid) < 0 || a[0] != 'x'){
+    printf(stdout, "pinned unmap: read went wrong\n");
+    exit();
+  }
+
+  b = sbrk(4096);
+  if((tid = thread_create(unmapreader, b)) < 0){
+    printf(stdout, "thread_create failed\n");
+    exit();
+  }
+  sleep(2);
+  if(sbrk(-4096) != (char*)-1){
+    printf(stdout, "pinned unmap: sbrk freed a pinned buffer\n");
+    exit();
+  }
+  write(unmappipe[1], "y", 1);
+  if(thread_join(tid) < 0 || b[0] != 'y'){
+    printf(stdout, "pinned unmap: read went wrong\n");
+    exit();
+  }
+
+  if(munmap(a, 4096) < 0 || sbrk(-4096) == (char*)-1){
+    printf(stdout, "pinned unmap: unmap after the read failed\n");
+    exit();
+  }
+  close(unmappipe[0]);
+  close(unmappipe[1]);
+  printf(stdout, "pinned unmap test ok\n");
+}
+
+// Fill more memory than the machine has, which pushes pages
+// out to swap, then check every page on the way back in.
+void
+swaptest(void)
+{
+  char *start, *a;
+  uint n, i;
+  int pid;
+
+  printf(stdout, "swap test\n");
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    start = sbrk(0);
+    n = 0;
+    while((a = sbrk(1024*1024)) != (char*)-1){
+      for(i = 0; i < 1024*1024; i += 4096){
+        *(uint*)(a + i) = n;
+        *(uint*)(a + i + 4092) = ~n;
+        n++;
+      }
+    }
+    // Memory and swap have run out. Give some back, so that
+    // faulting pages back in has room to swap others out.
+    sbrk(-4*1024*1024);
+    n -= 4*1024*1024/4096;
+    if(n*4096 < PHYSTOP - 32*1024*1024){
+      printf(stdout, "swap: only %d pages before running out\n", n);
+      exit();
+    }
+    for(i = 0; i < n; i++){
+      a = start + i*4096;
+      if(*(uint*)a != i || *(uint*)(a + 4092) != ~i){
+        printf(stdout, "swap: page %d corrupted\n", i);
+        exit();
+      }
+    }
+    exit();
+  }
+  wait();
+  printf(stdout, "swap test ok\n");
+}
+
+// A writer blocked on a full pipe with only a few bytes left
+// to write must be woken when that much room frees up, even
+// if the reader then waits for it rather than draining more.
+void
+pipewaketest(void)
+{
+  static char buf[PIPEPAGES*4096 + 10];
+  int data[2], done[2], pid;
+  char c;
+
+  printf(stdout, "pipe wake test\n");
+  if(pipe(data) < 0 || pipe(done) < 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(write(data[1], buf, sizeof(buf)) != sizeof(buf))
+      printf(stdout, "pipe wake: short write\n");
+    write(done[1], "x", 1);
+    exit();
+  }
+  sleep(2);  // let the writer fill the pipe and block
+  if(read(data[0], buf, 10) != 10 || read(done[0], &c, 1) != 1){
+    printf(stdout, "pipe wake: read failed\n");
+    exit();
+  }
+  wait();
+  close(data[0]);
+  close(data[1]);
+  close(done[0]);
+  close(done[1]);
+  printf(stdout, "pipe wake test ok\n");
+}
+
+void
+polltest(void)
+{
+  struct pollfd pfd[3];
+  int a[2], b[2], pid;
+
+  printf(stdout, "poll test\n");
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  pfd[0].fd = a[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = b[0];
+  pfd[1].events = POLLIN;
+  pfd[2].fd = b[1];
+  pfd[2].events = POLLOUT;
+  if(poll(pfd, 2, 0) != 0){
+    printf(stdout, "poll: empty pipes ready\n");
+    exit();
+  }
+  if(poll(pfd, 2, 2) != 0){
+    printf(stdout, "poll: timeout failed\n");
+    exit();
+  }
+  if(poll(pfd, 3, 0) != 1 || pfd[2].revents != POLLOUT){
+    printf(stdout, "poll: pipe not writable\n");
+    exit();
+  }
+
+  // Wake up when a child writes to the second pipe.
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    sleep(2);
+    write(b[1], "x", 1);
+    exit();
+  }
+  if(poll(pfd, 2, -1) != 1 || pfd[0].revents != 0 || pfd[1].revents != POLLIN){
+    printf(stdout, "poll: did not see the write\n");
+    exit();
+  }
+  wait();
+
+  close(a[1]);
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLHUP){
+    printf(stdout, "poll: did not see the close\n");
+    exit();
+  }
+  close(a[0]);
+  close(b[0]);
+  close(b[1]);
+  pfd[0].fd = a[0];
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLNVAL){
+    printf(stdout, "poll: closed fd not reported\n");
+    exit();
+  }
+  printf(stdout, "poll test ok\n");
+}
+
+void
+nonblocktest(void)
+{
+  int fds[2], n, tot;
+
+  printf(stdout, "nonblock test\n");
+  if(pipe(fds) < 0){
+    printf(stdout, "pipe() failed\n");
+    exit();
+  }
+  if(fcntl(fds[0], F_SETFL, O_NONBLOCK) < 0 ||
+     fcntl(fds[1], F_SETFL, O_NONBLOCK) < 0){
+    printf(stdout, "nonblock: fcntl failed\n");
+    exit();
+  }
+  if(fcntl(fds[0], F_GETFL, 0) != (O_RDONLY|O_NONBLOCK) ||
+     fcntl(fds[1], F_GETFL, 0) != (O_WRONLY|O_NONBLOCK)){
+    printf(stdout, "nonblock: wrong flags\n");
+    exit();
+  }
+  if(read(fds[0], buf, 1) != -EAGAIN){
+    printf(stdout, "nonblock: read of empty pipe did not fail\n");
+    exit();
+  }
+  // Fill the pipe: the last write comes up short.
+  tot = 0;
+  while((n = write(fds[1], buf, sizeof(buf))) > 0)
+    tot += n;
+  if(n != -EAGAIN || tot != PIPEPAGES*4096){
+    printf(stdout, "nonblock: filled pipe with %d bytes\n", tot);
+    exit();
+  }
+  while((n = read(fds[0], buf, sizeof(buf))) > 0)
+    tot -= n;
+  if(n != -EAGAIN || tot != 0){
+    printf(stdout, "nonblock: drained pipe short by %d bytes\n", tot);
+    exit();
+  }
+  close(fds[1]);
+  if(read(fds[0], buf, 1) != 0){
+    printf(stdout, "nonblock: no end of file\n");
+    exit();
+  }
+  close(fds[0]);
+  printf(stdout, "nonblock test ok\n");
+}
+
+void
+shmtest(void)
+{
+  int id, pid, i;
+  char *p;
+
+  printf(stdout, "shm test\n");
+  if((id = shmget(4242, 3*4096, IPC_CREAT|IPC_EXCL)) < 0){
+    printf(stdout, "shmget failed\n");
+    exit();
+  }
+  if(shmget(4242, 3*4096, IPC_CREAT|IPC_EXCL) >= 0 ||
+     shmget(4242, 4*4096, 0) >= 0){
+    printf(stdout, "shm: shmget should have failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // Find the segment by its key, as an unrelated process would.
+    if((p = shmat(shmget(4242, 1, 0))) == (char*)-1)
+      exit();
+    for(i = 0; i < 3*4096; i++)
+      p[i] = i % 251;
+    shmdt(p);
+    exit();
+  }
+  wait();
+  if((p = shmat(id)) == (char*)-1){
+    printf(stdout, "shmat failed\n");
+    exit();
+  }
+  // The segment outlives its removal while attached.
+  if(shmctl(id, IPC_RMID) < 0 || shmget(4242, 1, 0) >= 0){
+    printf(stdout, "shm: IPC_RMID failed\n");
+    exit();
+  }
+  for(i = 0; i < 3*4096; i++){
+    if(p[i] != (char)(i % 251)){
+      printf(stdout, "shm: wrong byte at %d\n", i);
+      exit();
+    }
+  }
+  if(shmdt(p) < 0 || shmdt(p) >= 0){
+    printf(stdout, "shmdt failed\n");
+    exit();
+  }
+  printf(stdout, "shm test ok\n");
+}
+
+void
+clocktest(void)
+{
+  struct timespec t0, t1, req;
+  uint us;
+
+  printf(stdout, "clock test\n");
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) < 0 || t0.tv_nsec >= 1000000000){
+    printf(stdout, "clock_gettime failed\n");
+    exit();
+  }
+  // Well under a clock tick.
+  req.tv_sec = 0;
+  req.tv_nsec = 2000000;
+  if(nanosleep(&req) < 0){
+    printf(stdout, "nanosleep failed\n");
+    exit();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  us = (t1.tv_sec - t0.tv_sec) * 1000000 + t1.tv_nsec / 1000 - t0.tv_nsec / 1000;
+  if(us < 2000 || us > 1000000){
+    printf(stdout, "clock: nanosleep of 2000us took %dus\n", us);
+    exit();
+  }
+  req.tv_nsec = 1000000000;
+  if(nanosleep(&req) != -1){
+    printf(stdout, "clock: nanosleep took a bad request\n");
+    exit();
+  }
+  printf(stdout, "clock test ok\n");
+}
+
+// Clock ticks keep counting while every CPU sits idle
+// with its clock tick stopped.
+void
+idleticktest(void)
+{
+  uint t0, t1;
+
+  printf(stdout, "idle tick test\n");
+  t0 = uptime();
+  if(sleep(0) < 0 || sleep(10) < 0){
+    printf(stdout, "idle tick: sleep failed\n");
+    exit();
+  }
+  t1 = uptime();
+  if(t1 - t0 < 10 || t1 - t0 > 100){
+    printf(stdout, "idle tick: sleep(10) took %d ticks\n", t1 - t0);
+    exit();
+  }
+  printf(stdout, "idle tick test ok\n");
+}
+
 unsigned long randstate = 1;
 unsigned int
 rand()
@@ -1768,7 +2790,26 @@ main(int argc, char *argv[])
   bigargtest();
   bsstest();
   sbrktest();
+  swaptest();
   validatetest();
+  mmaptest();
+  pagecachetest();
+  sharedreadtest();
+  texttest();
+  vdsotest();
+  ringtest();
+  splicetest();
+  futextest();
+  threadtest();
+  threadfdtest();
+  shootdowntest();
+  faultunmaptest();
+  pinnedunmaptest();
+  polltest();
+  nonblocktest();
+  shmtest();
+  clocktest();
+  idleticktest();
 
   opentest();
   writetest();
@@ -1780,7 +2821,9 @@ main(int argc, char *argv[])
   iputtest();
 
   mem();
+  execunaligned();
   pipe1();
+  pipewaketest();
   preempt();
   exitwait();
 
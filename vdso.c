@@ -0,0 +1,81 @@
+// Kernel data that user programs read without a system call.
+//
+// Every user address space maps two read-only pages just below
+// KERNBASE (see vdso.h): the vdso page, shared by all processes
+// and kept up to date by the clock tick, and a page of the
+// process's own, holding its pid. getpid() and uptime() in
+// ulib.c read these instead of entering the kernel. Threads
+// share the pid page along with the rest of the address space,
+// so clone() clears it (vdsothreaded) to send getpid() to the
+// kernel.
+//
+// The timer updates the shared page under a sequence count:
+// seq is odd during an update, so a reader that sees seq odd,
+// or changed by the time it is done, reads again.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "vdso.h"
+
+static struct vdso *vdso;
+
+void
+vdsoinit(void)
+{
+  if((vdso = (struct vdso*)kalloc_zeroed()) == 0)
+    panic("vdsoinit");
+}
+
+// Record that ticks clock ticks have passed, the last of
+// them at TSC value tsc, tsctick cycles apart.
+// Called holding tickslock.
+void
+vdsotick(uint ticks, uint64 tsc, uint tsctick)
+{
+  vdso->seq++;
+  __sync_synchronize();
+  vdso->ticks = ticks;
+  vdso->tsc = tsc;
+  vdso->tsctick = tsctick;
+  __sync_synchronize();
+  vdso->seq++;
+}
+
+// pgdir is about to be shared by several threads, which have
+// different pids: stop getpid() from trusting the pid page.
+void
+vdsothreaded(pde_t *pgdir)
+{
+  char *mem;
+
+  if((mem = uva2ka(pgdir, (char*)VDSOPROC)) == 0)
+    panic("vdsothreaded");
+  ((struct vdsoproc*)mem)->pid = 0;
+}
+
+// Map the vdso pages into pgdir for process pid.
+// Returns 0 on success, -1 if memory runs out; any page
+// already mapped is freed along with pgdir.
+int
+vdsomap(pde_t *pgdir, int pid)
+{
+  char *mem;
+
+  if((mem = kalloc_evict(1)) == 0)
+    return -1;
+  ((struct vdsoproc*)mem)->pid = pid;
+  if(mappages(pgdir, (char*)VDSOPROC, PGSIZE, V2P(mem), PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  kincref((char*)vdso);
+  if(mappages(pgdir, (char*)VDSO, PGSIZE, V2P(vdso), PTE_U) < 0){
+    kfree((char*)vdso);
+    return -1;
+  }
+  return 0;
+}
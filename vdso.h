@@ -0,0 +1,18 @@
+// Pages of kernel data that user programs read without a
+// system call, mapped read-only at the top of every user
+// address space (see vdso.c).
+// Both the kernel and user programs use this header file.
+
+#define VDSO     0x7FFFE000         // Shared by all processes
+#define VDSOPROC (VDSO + 0x1000)    // The process's own
+
+struct vdso {
+  uint seq;       // Odd while the timer is updating the page
+  uint ticks;     // Clock ticks since boot, as uptime()
+  uint64 tsc;     // TSC when the last tick was due
+  uint tsctick;   // TSC cycles per tick
+};
+
+struct vdsoproc {
+  int pid;        // 0 once the address space has several threads
+};
@@ -6,10 +6,18 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "vmspace.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
 
+struct {
+  struct spinlock lock;
+  struct vmspace vm[NPROC];
+} vmtable;
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void
@@ -32,7 +40,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -42,10 +50,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -57,7 +64,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -121,9 +128,8 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
@@ -160,7 +166,7 @@ switchuvm(struct proc *p)
     panic("switchuvm: no process");
   if(p->kstack == 0)
     panic("switchuvm: no kstack");
-  if(p->pgdir == 0)
+  if(p->vm == 0 || p->vm->pgdir == 0)
     panic("switchuvm: no pgdir");
 
   pushcli();
@@ -173,7 +179,9 @@ switchuvm(struct proc *p)
   // forbids I/O instructions (e.g., inb and outb) from user space
   mycpu()->ts.iomb = (ushort) 0xFFFF;
   ltr(SEG_TSS << 3);
-  lcr3(V2P(p->pgdir));  // switch to process's address space
+  wrmsr(MSR_SYSENTER_ESP, (uint)p->kstack + KSTACKSIZE);
+  mycpu()->vm = p->vm;
+  lcr3(V2P(p->vm->pgdir));  // switch to process's address space
   popcli();
 }
 
@@ -186,8 +194,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
@@ -216,6 +223,45 @@ loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
   return 0;
 }
 
+// Map a read-only program segment into pgdir at addr, which
+// must be page-aligned, sharing the pages with every other
+// process running the same program (see pcache.c).
+// The segment is filesz bytes of ip starting at offset, which
+// must also be page-aligned, padded with zeros to memsz bytes.
+// Caller must hold ip->lock.
+int
+loadshared(pde_t *pgdir, char *addr, struct inode *ip, uint offset,
+           uint filesz, uint memsz)
+{
+  uint i, n;
+  char *mem, *page;
+
+  if((uint) addr % PGSIZE != 0 || offset % PGSIZE != 0)
+    panic("loadshared: not page aligned");
+  for(i = 0; i < memsz; i += PGSIZE){
+    if(i < filesz){
+      n = filesz - i < PGSIZE ? filesz - i : PGSIZE;
+      mem = pcacheget(ip, offset+i);
+      if(mem && n < PGSIZE){
+        // The cached page may go on with the rest of the file,
+        // where the segment needs zeros: copy its start.
+        page = mem;
+        if((mem = kalloc_zeroed()) != 0)
+          memmove(mem, page, n);
+        kfree(page);
+      }
+    } else
+      mem = kalloc_zeroed();
+    if(mem == 0)
+      return -1;
+    if(mappages(pgdir, addr+i, PGSIZE, V2P(mem), PTE_U) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  return 0;
+}
+
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -231,13 +277,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_evict(1);
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -273,6 +318,9 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       char *v = P2V(pa);
       kfree(v);
       *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(*pte);
+      *pte = 0;
     }
   }
   return newsz;
@@ -297,6 +345,163 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
+#define TLBFLUSHALL 32  // flush more pages than this by reloading %cr3
+#define NBATCH      64  // pages uvmunmap() frees per shootdown
+
+struct tlbrange {
+  struct vmspace *vm;
+  uint start, end;
+};
+
+// Drop [r->start, r->end) of r->vm from this CPU's TLB, if
+// this CPU has r->vm loaded. Runs on other CPUs via ipicall().
+static void
+tlbflushlocal(void *arg)
+{
+  struct tlbrange *r = arg;
+  uint a;
+
+  if(mycpu()->vm != r->vm)
+    return;
+  if(r->end - r->start > TLBFLUSHALL*PGSIZE)
+    lcr3(V2P(r->vm->pgdir));
+  else
+    for(a = r->start; a < r->end; a += PGSIZE)
+      invlpg((void*)a);
+}
+
+// TLB shootdown: make sure that no CPU's TLB still holds a PTE
+// of vm for [start, end) from before the caller changed them.
+// Sends a single IPI to each other CPU that has vm loaded,
+// however large the range. Caller must hold no spinlock (see
+// ipi.c).
+void
+tlbflush(struct vmspace *vm, uint start, uint end)
+{
+  struct tlbrange r;
+  uint mask;
+  int i;
+
+  r.vm = vm;
+  r.start = PGROUNDDOWN(start);
+  r.end = PGROUNDUP(end);
+  // The new PTEs must be visible before looking at which CPUs
+  // have vm loaded: a CPU that loads it later sees them.
+  __sync_synchronize();
+  pushcli();
+  tlbflushlocal(&r);
+  mask = 0;
+  for(i = 0; i < ncpu; i++)
+    if(cpus[i].vm == vm && &cpus[i] != mycpu())
+      mask |= 1 << i;
+  popcli();
+  if(mask)
+    ipicall(mask, tlbflushlocal, &r);
+}
+
+// Remove the user pages in [start, end) from vm and free them.
+// Other threads of vm may be running with the old PTEs in their
+// TLBs, so a page is freed only once it has been shot down,
+// which is done for up to NBATCH pages at a time.
+// Caller must hold vm->lock, and no spinlock.
+void
+uvmunmap(struct vmspace *vm, uint start, uint end)
+{
+  char *batch[NBATCH];
+  pte_t *pte;
+  uint a, from;
+  int n, i;
+
+  a = PGROUNDUP(start);
+  while(a < end){
+    from = a;
+    for(n = 0; a < end && n < NBATCH; a += PGSIZE){
+      if((pte = walkpgdir(vm->pgdir, (char*)a, 0)) == 0){
+        a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+        continue;
+      }
+      if(*pte & PTE_P)
+        batch[n++] = P2V(PTE_ADDR(*pte));
+      else if(*pte & PTE_SWAP)
+        swapfree(*pte);
+      *pte = 0;
+    }
+    if(n > 0)
+      tlbflush(vm, from, a);
+    for(i = 0; i < n; i++)
+      kfree(batch[i]);
+  }
+}
+
+void
+vmspaceinit(void)
+{
+  int i;
+
+  initlock(&vmtable.lock, "vmtable");
+  for(i = 0; i < NPROC; i++)
+    initsleeplock(&vmtable.vm[i].lock, "vmspace");
+}
+
+// Allocate an empty address space, with no page table yet.
+// Returns 0 if there is no free slot.
+struct vmspace*
+vmspacealloc(void)
+{
+  struct vmspace *vm;
+
+  acquire(&vmtable.lock);
+  for(vm = vmtable.vm; vm < &vmtable.vm[NPROC]; vm++){
+    if(vm->ref == 0){
+      vm->ref = 1;
+      release(&vmtable.lock);
+      return vm;
+    }
+  }
+  release(&vmtable.lock);
+  return 0;
+}
+
+// Increment ref count for vm, for a new thread.
+struct vmspace*
+vmspacedup(struct vmspace *vm)
+{
+  acquire(&vmtable.lock);
+  if(vm->ref < 1)
+    panic("vmspacedup");
+  vm->ref++;
+  release(&vmtable.lock);
+  return vm;
+}
+
+// Drop a reference to vm. The last one frees its regions,
+// its page table and all the memory in it.
+// May sleep, closing mapped files.
+void
+vmspaceput(struct vmspace *vm)
+{
+  acquire(&vmtable.lock);
+  if(vm->ref < 1)
+    panic("vmspaceput");
+  if(vm->ref > 1){
+    vm->ref--;
+    release(&vmtable.lock);
+    return;
+  }
+  release(&vmtable.lock);
+
+  // The only reference left is ours: nobody else can look.
+  vmafree(vm);
+  if(vm->pgdir)
+    freevm(vm->pgdir);
+  vm->pgdir = 0;
+  vm->sz = 0;
+
+  acquire(&vmtable.lock);
+  vm->ref = 0;
+  release(&vmtable.lock);
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -317,7 +522,7 @@ copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
   pte_t *pte;
-  uint pa, i, flags;
+  uint i, flags;
   char *mem;
 
   if((d = setupkvm()) == 0)
@@ -325,13 +530,23 @@ copyuvm(pde_t *pgdir, uint sz)
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
       panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
+    if(!(*pte & (PTE_P|PTE_SWAP)))
       panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
+    if((*pte & (PTE_P|PTE_U|PTE_W)) == (PTE_P|PTE_U)){
+      // Read-only pages, such as shared text, need no copy.
+      mem = P2V(PTE_ADDR(*pte));
+      kincref(mem);
+    } else {
+      // Allocating may sleep and let the page be swapped
+      // out, so look at the PTE again afterwards.
+      if((mem = kalloc_evict(0)) == 0)
+        goto bad;
+      if(*pte & PTE_P)
+        memmove(mem, (char*)P2V(PTE_ADDR(*pte)), PGSIZE);
+      else
+        swapread(*pte, mem);
+    }
+    flags = PTE_FLAGS(*pte) & ~(PTE_P|PTE_SWAP);
     if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
       kfree(mem);
       goto bad;
@@ -344,6 +559,169 @@ bad:
   return 0;
 }
 
+// Handle a page fault at user address va in the current process.
+// err is the error code pushed by the processor.
+// Returns 0 if the faulting access can be retried, -1 if
+// the address is not valid for that access.
+int
+pagefault(uint va, uint err)
+{
+  struct vmspace *vm = myproc()->vm;
+  pte_t *pte;
+  int r;
+
+  if(va >= KERNBASE)
+    return -1;
+  if(err & FEC_PR)  // page is present; access not permitted
+    return -1;
+  acquiresleep(&vm->lock);
+  pte = walkpgdir(vm->pgdir, (char*)va, 0);
+  if(pte && (*pte & PTE_P)){
+    // Another thread faulted the page in first.
+    if((*pte & PTE_U) == 0 || ((err & FEC_WR) && (*pte & PTE_W) == 0))
+      r = -1;
+    else
+      r = 0;
+  } else if(pte && (*pte & PTE_SWAP)){
+    if((err & FEC_WR) && (*pte & PTE_W) == 0)
+      r = -1;
+    else
+      r = swapin(vm->pgdir, PGROUNDDOWN(va));
+  } else
+    r = vmafault(vm, va, err & FEC_WR);
+  releasesleep(&vm->lock);
+  return r;
+}
+
+// Check that the current process may access the user memory
+// [va, va+len), and make every page in it present, faulting
+// in mmap()ed pages that have not been touched yet and pages
+// that were swapped out.
+// If write is set the memory must also be writable.
+// The memory stays pinned, safe from being swapped out again,
+// until the current system call returns (see syscall()).
+// Returns 0 if so, -1 otherwise.
+int
+uvmcheck(uint va, uint len, int write)
+{
+  struct proc *curproc = myproc();
+  struct vmspace *vm = curproc->vm;
+  pte_t *pte;
+  uint a, last;
+  int i, r;
+
+  if(va >= KERNBASE || va + len > KERNBASE || va + len < va)
+    return -1;
+  if(len == 0)
+    return 0;
+
+  // Pin before faulting pages in: bringing in one page may
+  // sleep, and another process could swap out the ones
+  // already brought in. If out of slots, widen the last one.
+  if(curproc->npin < NPIN){
+    i = curproc->npin++;
+    curproc->pinstart[i] = va;
+    curproc->pinend[i] = va + len;
+  } else {
+    i = NPIN - 1;
+    if(va < curproc->pinstart[i])
+      curproc->pinstart[i] = va;
+    if(va + len > curproc->pinend[i])
+      curproc->pinend[i] = va + len;
+  }
+
+  a = PGROUNDDOWN(va);
+  last = PGROUNDDOWN(va + len - 1);
+  r = -1;
+  acquiresleep(&vm->lock);
+  for(;;){
+    pte = walkpgdir(vm->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_SWAP)){
+      if(swapin(vm->pgdir, a) < 0)
+        goto out;
+    } else if(pte == 0 || (*pte & PTE_P) == 0){
+      if(vmafault(vm, a, write) < 0)
+        goto out;
+      pte = walkpgdir(vm->pgdir, (char*)a, 0);
+    }
+    if((*pte & PTE_U) == 0)
+      goto out;
+    if(write && (*pte & PTE_W) == 0)
+      goto out;
+    if(a == last)
+      break;
+    a += PGSIZE;
+  }
+  r = 0;
+out:
+  releasesleep(&vm->lock);
+  return r;
+}
+
+// Copy len bytes from user address va of the current process
+// to dst, checking each page once rather than each access.
+// Returns 0 on success, -1 if the memory is not readable.
+int
+copyin(void *dst, uint va, uint len)
+{
+  struct proc *curproc = myproc();
+  char *d;
+  uint n;
+  int npin;
+
+  d = (char*)dst;
+  npin = curproc->npin;
+  while(len > 0){
+    n = PGSIZE - va%PGSIZE;
+    if(n > len)
+      n = len;
+    // Pinned only for the copy.
+    if(uvmcheck(va, n, 0) < 0){
+      curproc->npin = npin;
+      return -1;
+    }
+    memmove(d, (char*)va, n);
+    curproc->npin = npin;
+    len -= n;
+    d += n;
+    va += n;
+  }
+  return 0;
+}
+
+// Copy the nul-terminated string at user address va of the
+// current process to dst, which has room for max bytes,
+// a page at a time.
+// Returns the length of the string, not including the nul,
+// or -1 if the memory is not readable or the string too long.
+int
+copyinstr(char *dst, uint va, uint max)
+{
+  struct proc *curproc = myproc();
+  char *s;
+  uint n, i;
+  int npin;
+
+  npin = curproc->npin;
+  for(i = 0; i < max; ){
+    n = PGSIZE - va%PGSIZE;
+    if(n > max - i)
+      n = max - i;
+    if(uvmcheck(va, n, 0) < 0)
+      break;
+    for(s = (char*)va; s < (char*)va + n; s++, i++){
+      if((dst[i] = *s) == 0){
+        curproc->npin = npin;
+        return i;
+      }
+    }
+    curproc->npin = npin;
+    va += n;
+  }
+  curproc->npin = npin;
+  return -1;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -352,7 +730,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
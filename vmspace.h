@@ -0,0 +1,21 @@
+// A region of user memory created by mmap().
+// Pages are filled in on first touch (see vmafault in mmap.c).
+struct vma {
+  uint addr;                   // Start address; 0 if the slot is free
+  uint len;                    // Length in bytes, a multiple of PGSIZE
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE, MAP_ANONYMOUS
+  struct file *f;              // Mapped file, or 0 if anonymous
+  uint off;                    // File offset of addr
+};
+
+// A user address space, shared by all the threads of a process
+// (see clone in proc.c). lock serializes changes to it: growing
+// and shrinking it, mmap() and munmap(), and faulting pages in.
+struct vmspace {
+  int ref;                     // Threads using it; 0 if the slot is free
+  struct sleeplock lock;
+  pde_t *pgdir;                // Page table
+  uint sz;                     // Size of process memory (bytes)
+  struct vma vma[NVMA];        // Memory-mapped regions
+};